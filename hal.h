@@ -0,0 +1,96 @@
+/*
+ * Hardware abstraction for the game. main.c only talks to the board through
+ * what is declared here; the backend is picked at compile time:
+ *
+ *	hal_avr.c	ATmega1284 - Timer1 tick, ADC joysticks, PINB buttons,
+ *			Nokia 5110 over nokia5110.c (or interrupt driven SPI),
+ *			Timer3 cycle counter, USART0
+ *	hal_linux.c	headless workstation build (-DHAL_LINUX) - virtual clock,
+ *			scripted or replayed inputs, in-memory 84x48 display
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/pgmspace.h> // host/avr/pgmspace.h on the Linux build
+
+// TIMER
+// The tick period is fixed at compile time: define HAL_TICK_MS (ms) before
+// including this file. TimerOn() starts the tick and TimerWait() returns
+// once it has elapsed (TimerFlag is set by the tick), idling the CPU in a
+// sleep mode where the board has one. The tick also counts up until
+// TimerWait() takes the count, so a caller that overran learns how many
+// ticks it owes.
+#ifndef HAL_TICK_MS
+#define HAL_TICK_MS 1
+#endif
+extern volatile unsigned char TimerFlag;
+void TimerOn();
+void TimerOff();
+unsigned char TimerWait(); // ticks since the last call, more than 1 after an overrun
+unsigned short halTicks(); // ticks since power on, wraps
+unsigned short halSleepShare(); // part of the tick the last TimerWait() slept, 1/1000
+unsigned short halTickLatency(); // cycles since the tick, right after TimerWait() its spread is the jitter
+
+// CYCLE COUNTER
+// Free running 16 bit count of CPU cycles, so differences up to ~4 ms at
+// 16 MHz are exact. halCyclesLong() is the same count 32 bits wide, for
+// spans up to ~268 s. On Linux it is host time scaled to F_CPU.
+void halCyclesInit();
+unsigned short halCycles();
+unsigned long halCyclesLong();
+
+// INPUT
+#define HAL_JOY_Y 0 // player 1 up/down
+#define HAL_JOY_X 1 // player 1 left/right
+#define HAL_JOY2_X 2 // player 2 left/right
+#define HAL_JOY_SLOTS 3
+
+#define HAL_BUTTON_SHOOT 0x01
+#define HAL_BUTTON_SHOOT2 0x02
+#define HAL_BUTTON_RESET 0x04
+
+void halInputInit();
+unsigned char halJoystick(unsigned char slot); // 0-255, ~128 centered
+unsigned short halJoystickAge(unsigned char slot); // halTicks() since the slot was last sampled
+unsigned char halButtons(); // HAL_BUTTON_* bits, 1 = pressed
+
+// DISPLAY
+// The backend provides the framebuffer lcdScreen[6 * 84] (bank major, bit 0 =
+// top pixel of the bank); the game draws into it and hands halLcdWrite() the
+// runs of bytes that have to go to the glass, then calls halLcdFlush(). A
+// backend may send in the background; while halLcdBusy() the previous frame
+// is still going out and no new runs may be written.
+void halLcdInit();
+unsigned char halLcdBusy();
+void halLcdWrite(unsigned char bank, unsigned char x, const unsigned char *data, unsigned char len);
+void halLcdFlush();
+
+// SERIAL (only with HAL_SERIAL)
+// halSerialWrite() queues all len bytes or none of them and never waits.
+void halSerialInit(unsigned long baud);
+unsigned char halSerialWrite(const unsigned char *data, unsigned char len);
+
+// RECORD / REPLAY (only backends that define HAL_REPLAY, and HAL_CHECKSUM)
+// The game hands over its input records (replay.h) and one state checksum
+// per tick; where they are kept is up to the backend.
+void halRecordWrite(const unsigned char *data, unsigned char len);
+unsigned char halReplayRead(unsigned char *data, unsigned char len); // 0 - nothing (left) to replay
+void halChecksum(unsigned long tick, unsigned short sum);
+
+// CHECKPOINT (only backends that define HAL_CHECKPOINT)
+// Asked after every tick's checksum whether the game should keep a
+// checkpoint or go back to the one it kept; the backend keeps and restores
+// its own input position along with it.
+#define HAL_CHECKPOINT_TAKE 1
+#define HAL_CHECKPOINT_RESTORE 2
+unsigned char halCheckpoint(unsigned long tick); // 0, HAL_CHECKPOINT_TAKE or HAL_CHECKPOINT_RESTORE
+
+// Stop for good once queued serial output is out (simavr exits here).
+void halHalt();
+
+#endif
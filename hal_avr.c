@@ -0,0 +1,491 @@
+/*
+ * ATmega1284 backend for hal.h
+ *
+ * Port B: PB0 shoot, PB1 shoot2, PB2 reset (active low, pull-ups on)
+ * Port A: ADC0 joystick 1 Y, ADC1 joystick 1 X, ADC4 joystick 2 X
+ * Port D: Nokia 5110 (pins in nokia5110.h), TXD0 for telemetry
+ *	with -DLCD_SPI the 5110's DIN goes on MOSI (PB5) and CLK on SCK (PB7)
+ *
+ * -DREPLAY_DATA=\"file.h\" plays a recording from flash instead of the
+ * joysticks and buttons; file.h defines replayData[] in PROGMEM holding the
+ * records of a replay.h recording without the magic (tools/simbench.sh
+ * writes one).
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <util/atomic.h>
+#include <avr/sleep.h>
+
+#include "nokia5110.c"
+
+#define lcdScreen nokia_lcd.screen // reuse the library's buffer instead of a second 504 bytes
+
+// TIMING BEGIN
+// Timer1 in CTC mode interrupts exactly every HAL_TICK_MS, so the ISR only
+// has to flag the tick. The prescaler and OCR1A are worked out here at
+// compile time from F_CPU, taking the smallest prescaler whose count fits in
+// 16 bits for the finest resolution.
+#define TIMER_CYCLES (F_CPU / 1000UL * HAL_TICK_MS) // CPU cycles per tick
+#if TIMER_CYCLES <= 65536UL
+#define TIMER_PRESCALE 1
+#define TIMER_CS (1 << CS10)
+#elif TIMER_CYCLES / 8 <= 65536UL
+#define TIMER_PRESCALE 8
+#define TIMER_CS (1 << CS11)
+#elif TIMER_CYCLES / 64 <= 65536UL
+#define TIMER_PRESCALE 64
+#define TIMER_CS ((1 << CS11) | (1 << CS10))
+#elif TIMER_CYCLES / 256 <= 65536UL
+#define TIMER_PRESCALE 256
+#define TIMER_CS (1 << CS12)
+#elif TIMER_CYCLES / 1024 <= 65536UL
+#define TIMER_PRESCALE 1024
+#define TIMER_CS ((1 << CS12) | (1 << CS10))
+#else
+#error "HAL_TICK_MS is too long for Timer1 at this F_CPU"
+#endif
+#if TIMER_CYCLES == 0 || F_CPU % 1000UL || TIMER_CYCLES % TIMER_PRESCALE
+#error "HAL_TICK_MS is not a whole number of Timer1 counts at this F_CPU"
+#endif
+#define TIMER_COUNTS (TIMER_CYCLES / TIMER_PRESCALE) // per tick, OCR1A = TIMER_COUNTS - 1
+
+volatile unsigned char TimerFlag = 0; // set by the tick, cleared by TimerWait()
+volatile unsigned short _avr_timer_ticks = 0; // Ticks since power on, used to timestamp samples
+volatile unsigned char _avr_timer_pending = 0; // Ticks since TimerWait() last took them, saturates
+
+void TimerOn() {
+	TCCR1A = 0x00;
+	TCCR1B = (1 << WGM12) | TIMER_CS; // CTC, TCNT1 counts 0..OCR1A
+	OCR1A = TIMER_COUNTS - 1;
+	TCNT1 = 0;
+	TIMSK1 = (1 << OCIE1A); // compare match interrupt
+	sei();
+}
+
+void TimerOff() {
+	TCCR1B = 0x00; // no clock source, timer stopped
+}
+
+ISR(TIMER1_COMPA_vect) {
+	_avr_timer_ticks++;
+	if(_avr_timer_pending != 0xFF)
+	{
+		_avr_timer_pending++;
+	}
+	TimerFlag = 1;
+}
+
+// Sleeps (idle mode, Timer1 and the other peripherals keep running) until
+// the tick. Any interrupt wakes the CPU, so it goes back to sleep until the
+// tick's own has set TimerFlag. Before sleeping it notes how much of the tick
+// is left, for halSleepShare(). Returns the ticks that came since the last
+// call: 1 on time, more when the work in between overran.
+unsigned short _avr_sleep_share = 0; // 1/1000 of the last tick spent asleep
+
+unsigned char TimerWait() {
+	unsigned short elapsed; // timer counts since the tick started
+	unsigned char ticks;
+
+	cli();
+	elapsed = TCNT1;
+	if(TIFR1 & (1 << OCF1A)) // the next tick is already pending
+	{
+		elapsed = TIMER_COUNTS;
+	}
+	sei();
+	_avr_sleep_share = (!TimerFlag && elapsed < TIMER_COUNTS) ? (TIMER_COUNTS - elapsed) * 1000UL / TIMER_COUNTS : 0;
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while(!TimerFlag)
+	{
+		sleep_enable();
+		sei(); // sleep_cpu() runs before any interrupt can, so the wakeup is not missed
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	ticks = _avr_timer_pending;
+	_avr_timer_pending = 0;
+	TimerFlag = 0;
+	sei();
+	return ticks;
+}
+
+unsigned short halSleepShare() {
+	return _avr_sleep_share;
+}
+
+// Timer1 restarts from 0 on every tick, so its count right after TimerWait()
+// is how late the loop got going: interrupt and wakeup latency, or the whole
+// overrun when the tick's work did not fit.
+unsigned short halTickLatency() {
+	unsigned short counts;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		counts = TCNT1;
+	}
+	return (counts < 0xFFFFUL / TIMER_PRESCALE) ? counts * TIMER_PRESCALE : 0xFFFF;
+}
+
+unsigned short halTicks() {
+	unsigned short ticks;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ticks = _avr_timer_ticks;
+	}
+	return ticks;
+}
+// TIMING END
+
+// CYCLES BEGIN
+// Timer3 counts CPU cycles and its overflow interrupt counts the wraps,
+// every 65536 cycles, for halCyclesLong().
+volatile unsigned short _avr_cycles_high = 0; // Timer3 overflows
+
+void halCyclesInit()
+{
+	TCCR3A = 0x00;
+	TCCR3B = (1<<CS30); // normal mode, no prescaler - TCNT3 counts CPU cycles
+	TIMSK3 = (1<<TOIE3);
+}
+
+ISR(TIMER3_OVF_vect)
+{
+	_avr_cycles_high++;
+}
+
+unsigned short halCycles()
+{
+	return TCNT3;
+}
+
+unsigned long halCyclesLong()
+{
+	unsigned short high;
+	unsigned short low;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		high = _avr_cycles_high;
+		low = TCNT3;
+		if((TIFR3 & (1<<TOV3)) && low < 0x8000) // wrapped, the overflow is not counted yet
+		{
+			high++;
+		}
+	}
+	return ((unsigned long)high << 16) | low;
+}
+// CYCLES END
+
+// JOYSTICK BEGIN
+// The ADC scans in the background: each conversion complete interrupt stores
+// the finished channel in adcSample[] and starts the next one, so reading a
+// joystick is one byte load instead of a ~104 us blocking conversion.
+// Samples are left adjusted and only ADCH is kept (0-255).
+const unsigned char adcChannel[HAL_JOY_SLOTS] = {0, 1, 4};
+volatile unsigned char adcSample[HAL_JOY_SLOTS]; // latest reading of each slot
+volatile unsigned short adcStamp[HAL_JOY_SLOTS]; // _avr_timer_ticks when each slot was last sampled
+volatile unsigned char adcSlot = 0; // slot currently being converted
+
+void halInputInit()
+{
+	DDRB &= ~0x07; PORTB |= 0x07; // PB0-PB2 inputs with pull-ups, the rest may be SPI
+
+	for(unsigned char i = 0; i < HAL_JOY_SLOTS; i++)
+	{
+		adcSample[i] = 0x80; // joystick centered until the first sample lands
+	}
+	adcSlot = 0;
+	ADMUX = (1<<REFS0)|(1<<ADLAR)|adcChannel[0];
+	ADCSRA = (1<<ADEN)|(1<<ADIE)|(1<<ADPS0)|(1<<ADPS1)|(1<<ADPS2); //ENABLE ADC + INTERRUPT, PRESCALER 128
+	ADCSRA |= (1<<ADSC); // first conversion, the ISR keeps the scan going
+}
+
+ISR(ADC_vect)
+{
+	unsigned char slot = adcSlot;
+
+	adcSample[slot] = ADCH;
+	adcStamp[slot] = _avr_timer_ticks;
+
+	if(++slot >= HAL_JOY_SLOTS)
+	{
+		slot = 0;
+	}
+	adcSlot = slot;
+	ADMUX = (ADMUX & 0xE0)|adcChannel[slot]; // keep REFS/ADLAR, select next channel
+	ADCSRA |= (1<<ADSC); // START CONVERSION
+}
+
+unsigned char halJoystick(unsigned char slot)
+{
+	return adcSample[slot];
+}
+
+unsigned short halJoystickAge(unsigned char slot)
+{
+	unsigned short stamp;
+	unsigned short now;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		stamp = adcStamp[slot];
+		now = _avr_timer_ticks;
+	}
+	return now - stamp;
+}
+
+unsigned char halButtons()
+{
+	return ~PINB & (HAL_BUTTON_SHOOT | HAL_BUTTON_SHOOT2 | HAL_BUTTON_RESET);
+}
+// JOYSTICK END
+
+// DISPLAY BEGIN
+#ifdef LCD_SPI
+// -DLCD_SPI: the LCD's DIN and CLK are wired to the hardware SPI pins (MOSI
+// PB5, SCK PB7) instead of the nokia5110.h pins; SCE, RST and DC stay put.
+// halLcdWrite() copies each span into lcdFront[] and queues it, and after
+// halLcdFlush() the SPI transfer complete interrupt sends the queue one
+// byte at a time while the game goes on with the next tick. lcdFront[] only
+// changes while no transfer is running, so each frame goes out whole and
+// in order; lcdRender() waits for the next tick while halLcdBusy().
+#define LCD_SPANS 24
+
+typedef struct lcdSpan {
+	unsigned short pos; // bank * 84 + x
+	unsigned short len; // may run on into the next bank, like the controller does
+} lcdSpan;
+
+unsigned char lcdFront[6 * 84]; // what the glass shows once the queue is out
+lcdSpan lcdSpans[LCD_SPANS];
+volatile unsigned char lcdSpanCount; // queued, the ISR clears it when done
+unsigned char lcdSpanNext; // next span for the ISR
+volatile unsigned char lcdBusy;
+unsigned short lcdSendPos; // next lcdFront[] byte of the current span
+unsigned short lcdSendLeft;
+unsigned char lcdCommand; // bank address still to send, 0 - none
+
+void lcdSpanStart() // address the next span, or end the transfer; SPI is idle
+{
+	if(lcdSpanNext == lcdSpanCount)
+	{
+		PORT_LCD |= (1 << LCD_SCE);
+		lcdSpanCount = 0;
+		lcdBusy = 0;
+		return;
+	}
+	
+	lcdSpan *span = &lcdSpans[lcdSpanNext++];
+	lcdSendPos = span->pos;
+	lcdSendLeft = span->len;
+	lcdCommand = 0x40 | (span->pos / 84);
+	PORT_LCD &= ~(1 << LCD_DC);
+	SPDR = 0x80 | (span->pos % 84); // column address
+}
+
+ISR(SPI_STC_vect)
+{
+	if(lcdCommand)
+	{
+		SPDR = lcdCommand;
+		lcdCommand = 0;
+		return;
+	}
+	PORT_LCD |= (1 << LCD_DC); // addresses are out, data follows
+	if(lcdSendLeft)
+	{
+		SPDR = lcdFront[lcdSendPos++];
+		lcdSendLeft--;
+		return;
+	}
+	lcdSpanStart();
+}
+
+void lcdSpiSend(unsigned char byte) // polled, only while the interrupt is off
+{
+	SPDR = byte;
+	while(!(SPSR & (1 << SPIF)));
+	(void)SPDR; // SPSR then SPDR read clears SPIF, so enabling SPIE does not fire at once
+}
+
+// nokia_lcd_init() bit bangs on the nokia5110.h DIN/CLK pins, which are not
+// wired in this mode, so its sequence is sent through the SPI here instead.
+void halLcdInit()
+{
+	DDRD = 0xFF; PORTD = 0x00; // Configure port D's 8 pins as outputs, holds RST low
+	PORT_LCD |= (1 << LCD_SCE);
+	_delay_ms(70);
+	PORT_LCD |= (1 << LCD_RST); // out of reset
+	DDRB |= (1 << PB4) | (1 << PB5) | (1 << PB7); // SS must be an output to stay master
+	SPCR = (1 << SPE) | (1 << MSTR); // mode 0, MSB first, F_CPU/4 = 4 MHz (PCD8544 max)
+	
+	PORT_LCD &= ~((1 << LCD_SCE) | (1 << LCD_DC)); // commands
+	lcdSpiSend(0x21); // extended instruction set
+	lcdSpiSend(0x13); // bias 1:48
+	lcdSpiSend(0x06); // temperature coefficient
+	lcdSpiSend(0xC2); // Vop (contrast)
+	lcdSpiSend(0x20); // basic instruction set
+	lcdSpiSend(0x80); // column 0
+	lcdSpiSend(0x40); // bank 0
+	PORT_LCD |= (1 << LCD_DC); // display RAM is random after reset, the game only sends what changes
+	for(unsigned short i = 0; i < 6 * 84; i++)
+	{
+		lcdSpiSend(0x00);
+	}
+	PORT_LCD &= ~(1 << LCD_DC);
+	lcdSpiSend(0x0C); // normal mode
+	PORT_LCD |= (1 << LCD_SCE);
+	
+	lcdSpanCount = 0;
+	lcdBusy = 0;
+	SPCR |= (1 << SPIE); // from here on the interrupt sends
+}
+
+unsigned char halLcdBusy()
+{
+	return lcdBusy;
+}
+
+void halLcdWrite(unsigned char bank, unsigned char x, const unsigned char *data, unsigned char len)
+{
+	unsigned short pos = bank * 84 + x;
+	
+	for(unsigned char i = 0; i < len; i++)
+	{
+		lcdFront[pos + i] = data[i];
+	}
+	if(lcdSpanCount == LCD_SPANS) // out of spans, stretch the last one; the bytes between already match the glass
+	{
+		lcdSpans[LCD_SPANS - 1].len = pos + len - lcdSpans[LCD_SPANS - 1].pos;
+		return;
+	}
+	lcdSpans[lcdSpanCount].pos = pos;
+	lcdSpans[lcdSpanCount].len = len;
+	lcdSpanCount++;
+}
+
+void halLcdFlush()
+{
+	if(lcdSpanCount == 0)
+	{
+		return;
+	}
+	lcdBusy = 1;
+	lcdSpanNext = 0;
+	PORT_LCD &= ~(1 << LCD_SCE);
+	lcdSpanStart();
+}
+#else
+void halLcdInit()
+{
+	DDRD = 0xFF; PORTD = 0x00; // Configure port D's 8 pins as outputs
+	nokia_lcd_init();
+}
+
+unsigned char halLcdBusy()
+{
+	return 0; // halLcdWrite() is done when it returns
+}
+
+void halLcdWrite(unsigned char bank, unsigned char x, const unsigned char *data, unsigned char len)
+{
+	write_cmd(0x80 | x); // column address
+	write_cmd(0x40 | bank); // bank address
+	while(len--)
+	{
+		write_data(*data++);
+	}
+}
+
+void halLcdFlush()
+{
+}
+#endif
+// DISPLAY END
+
+// SERIAL BEGIN
+// Bytes are queued in a ring buffer that the data register empty interrupt
+// drains one at a time, so writing never waits on the UART.
+#ifdef HAL_SERIAL
+volatile unsigned char txBuffer[256]; // 8 bit indices wrap on their own
+volatile unsigned char txHead; // next free byte, only moved by halSerialWrite()
+volatile unsigned char txTail; // next byte to send, only moved by the ISR
+
+void halSerialInit(unsigned long baud)
+{
+	UBRR0 = (F_CPU + 4UL * baud) / (8UL * baud) - 1; // rounded, double speed
+	UCSR0A = (1<<U2X0);
+	UCSR0C = (1<<UCSZ01)|(1<<UCSZ00); // 8N1
+	UCSR0B = (1<<TXEN0);
+}
+
+ISR(USART0_UDRE_vect)
+{
+	unsigned char tail = txTail;
+
+	if(tail == txHead) // drained, stop interrupting until the next write
+	{
+		UCSR0B &= ~(1<<UDRIE0);
+		return;
+	}
+	UDR0 = txBuffer[tail];
+	txTail = tail + 1;
+}
+
+unsigned char halSerialWrite(const unsigned char *data, unsigned char len)
+{
+	unsigned char head = txHead;
+
+	if((unsigned char)(txTail - head - 1) < len)
+	{
+		return 0;
+	}
+	while(len--)
+	{
+		txBuffer[head++] = *data++;
+	}
+	txHead = head; // publish everything at once
+	UCSR0B |= (1<<UDRIE0);
+	return 1;
+}
+#endif
+// SERIAL END
+
+// REPLAY BEGIN
+#ifdef REPLAY_DATA
+#define HAL_REPLAY
+#include REPLAY_DATA
+
+unsigned short replayPos = 0; // next byte of replayData[]
+
+void halRecordWrite(const unsigned char *data, unsigned char len)
+{
+}
+
+unsigned char halReplayRead(unsigned char *data, unsigned char len)
+{
+	if(replayPos + len > sizeof(replayData))
+	{
+		return 0;
+	}
+	memcpy_P(data, &replayData[replayPos], len);
+	replayPos += len;
+	return 1;
+}
+#endif
+// REPLAY END
+
+void halHalt()
+{
+#ifdef HAL_SERIAL
+	while(txTail != txHead); // let the ISR drain the queue
+	_delay_us(200); // and the last two bytes leave the UART at 115200
+#endif
+	cli();
+	sleep_enable();
+	sleep_cpu(); // never woken with interrupts off; simavr ends the run here
+}
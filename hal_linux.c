@@ -0,0 +1,536 @@
+/*
+ * Headless Linux backend for hal.h
+ *
+ * Build:	cc -O2 -DHAL_LINUX -Ihost -o invaders main.c
+ *		(nokia5110_chars.h from the LCD library is still needed for the font,
+ *		and screens.h from tools/mkscreens.c)
+ *
+ * Run:	./invaders [-n ms] [-i script] [-e ms] [-s] [-t file]
+ *		[-r file] [-p file] [-k file] [-K file] [-o n] [-c a,b]
+ *	-n ms		stop after this much game time (default 60000, or
+ *			the end of the -p recording)
+ *	-i script	input script, see below (default: nothing pressed)
+ *	-e ms		print the display every ms of game time
+ *	-s		print the display when the run ends
+ *	-t file		write the serial port (telemetry) to file
+ *	-r file		record the inputs of every tick (format in replay.h)
+ *	-p file		replay a recording instead of the script, the run
+ *			ends when the recording does
+ *	-k file		write the state checksum of every tick
+ *	-K file		check every tick against a checksum log written by -k,
+ *			stop with exit status 1 at the first difference
+ *	-o n		every n-th TimerWait() finds the next tick gone by too,
+ *			as if the work had overrun, to exercise the catch-up
+ *	-c a,b		take a checkpoint after tick a and go back to it after
+ *			tick b (once), inputs included; with -K the ticks after
+ *			a are checked a second time. Not with -r
+ *
+ * Time is virtual: TimerWait() advances the clock by one timer period (two
+ * on a -o overrun) and returns at once, so a run goes as fast as the host
+ * can step the game.
+ *
+ * Input script, one line per change, inputs hold until the next line:
+ *	<ms> [up] [down] [left] [right] [left2] [right2] [shoot] [shoot2] [reset]
+ * e.g. "1000 shoot" then "1100" (nothing) then "1500 left shoot". Lines must
+ * be in time order; # starts a comment.
+ *
+ * A replay is bit exact: "-p run.inp -K run.sum" against a run that was made
+ * with "-r run.inp -k run.sum" must match on every tick, and so must
+ * "-p run.inp -K run.sum -c a,b", which replays ticks a + 1 .. b twice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nokia5110_chars.h"
+#include "replay.h"
+
+#define HAL_REPLAY // this backend keeps recordings and checksums, see main.c
+#define HAL_CHECKSUM
+#define HAL_CHECKPOINT
+
+int gameMain(void);
+void inputRecordFlush();
+
+unsigned char lcdScreen[6 * 84]; // what the game draws into
+unsigned char lcdGlass[6 * 84]; // what the display shows, built from halLcdWrite() runs
+
+// TIMING BEGIN
+volatile unsigned char TimerFlag = 0;
+const unsigned long simPeriod = HAL_TICK_MS; // ms per TimerWait()
+unsigned char simOn = 0;
+unsigned long simTime = 0; // virtual ms since power on
+unsigned long simEnd = 60000;
+unsigned long simEvery = 0; // -e
+unsigned char simShowEnd = 0; // -s
+unsigned long simOverrun = 0; // -o
+unsigned long simWaits = 0; // TimerWait() calls
+struct timespec simStart;
+
+void simApplyInputs();
+void simPrintScreen();
+void simReplayEnd();
+
+void TimerOn() {
+	simOn = 1;
+}
+
+void TimerOff() {
+	simOn = 0;
+}
+
+unsigned char TimerWait() {
+	unsigned char ticks = (simOverrun && ++simWaits % simOverrun == 0) ? 2 : 1;
+
+	for(unsigned char i = 0; i < ticks; i++)
+	{
+		simTime += simPeriod;
+		simApplyInputs();
+
+		if(simEvery && simTime % simEvery < simPeriod)
+		{
+			simPrintScreen();
+		}
+
+		if(simTime >= simEnd)
+		{
+			halHalt();
+		}
+	}
+	return ticks;
+}
+
+void halHalt() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double host = (now.tv_sec - simStart.tv_sec) + (now.tv_nsec - simStart.tv_nsec) / 1e9;
+
+	if(simShowEnd)
+	{
+		simPrintScreen();
+	}
+	inputRecordFlush();
+	simReplayEnd();
+	fprintf(stderr, "%lu ms of game time in %.3f s (%.0fx real time)\n", simTime, host, host > 0 ? simTime / 1000.0 / host : 0);
+	exit(0);
+}
+
+unsigned short halTicks() {
+	return simTime / simPeriod;
+}
+
+unsigned short halSleepShare() {
+	return 0; // virtual time, the work takes none of the tick
+}
+
+unsigned short halTickLatency() {
+	return 0; // and TimerWait() returns right on it
+}
+// TIMING END
+
+// CYCLES BEGIN
+void halCyclesInit()
+{
+}
+
+unsigned short halCycles() // host time, scaled to what F_CPU would count
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_nsec * (F_CPU / 1000000UL) / 1000ULL;
+}
+
+unsigned long halCyclesLong()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec) * (F_CPU / 1000000UL) / 1000ULL;
+}
+// CYCLES END
+
+// JOYSTICK BEGIN
+typedef struct simInput {
+	unsigned long time; // ms
+	unsigned char joy[HAL_JOY_SLOTS];
+	unsigned char buttons;
+} simInput;
+
+simInput *simScript = 0;
+unsigned int simScriptLen = 0;
+unsigned int simScriptNext = 0;
+unsigned char simJoy[HAL_JOY_SLOTS] = {0x80, 0x80, 0x80};
+unsigned char simButtons = 0;
+
+void simLoadScript(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+	unsigned int cap = 0;
+
+	if(!f)
+	{
+		perror(path);
+		exit(1);
+	}
+	while(fgets(line, sizeof(line), f))
+	{
+		char *hash = strchr(line, '#');
+		if(hash)
+		{
+			*hash = 0;
+		}
+
+		char *tok = strtok(line, " \t\r\n");
+		if(!tok)
+		{
+			continue;
+		}
+		if(simScriptLen == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			simScript = realloc(simScript, cap * sizeof(simInput));
+		}
+
+		simInput *in = &simScript[simScriptLen++];
+		in->time = strtoul(tok, 0, 10);
+		memset(in->joy, 0x80, sizeof(in->joy));
+		in->buttons = 0;
+		while((tok = strtok(0, " \t\r\n")))
+		{
+			if(!strcmp(tok, "up")) in->joy[HAL_JOY_Y] = 0xFF;
+			else if(!strcmp(tok, "down")) in->joy[HAL_JOY_Y] = 0x00;
+			else if(!strcmp(tok, "right")) in->joy[HAL_JOY_X] = 0xFF;
+			else if(!strcmp(tok, "left")) in->joy[HAL_JOY_X] = 0x00;
+			else if(!strcmp(tok, "right2")) in->joy[HAL_JOY2_X] = 0xFF;
+			else if(!strcmp(tok, "left2")) in->joy[HAL_JOY2_X] = 0x00;
+			else if(!strcmp(tok, "shoot")) in->buttons |= HAL_BUTTON_SHOOT;
+			else if(!strcmp(tok, "shoot2")) in->buttons |= HAL_BUTTON_SHOOT2;
+			else if(!strcmp(tok, "reset")) in->buttons |= HAL_BUTTON_RESET;
+			else
+			{
+				fprintf(stderr, "%s: unknown input '%s'\n", path, tok);
+				exit(1);
+			}
+		}
+	}
+	fclose(f);
+}
+
+void simApplyInputs()
+{
+	while(simScriptNext < simScriptLen && simScript[simScriptNext].time <= simTime)
+	{
+		memcpy(simJoy, simScript[simScriptNext].joy, sizeof(simJoy));
+		simButtons = simScript[simScriptNext].buttons;
+		simScriptNext++;
+	}
+}
+
+void halInputInit()
+{
+	simApplyInputs();
+}
+
+unsigned char halJoystick(unsigned char slot)
+{
+	return simJoy[slot];
+}
+
+unsigned short halJoystickAge(unsigned char slot)
+{
+	return 0; // always freshly sampled
+}
+
+unsigned char halButtons()
+{
+	return simButtons;
+}
+// JOYSTICK END
+
+// DISPLAY BEGIN
+void halLcdInit()
+{
+	memset(lcdGlass, 0, sizeof(lcdGlass));
+}
+
+unsigned char halLcdBusy()
+{
+	return 0;
+}
+
+void halLcdWrite(unsigned char bank, unsigned char x, const unsigned char *data, unsigned char len)
+{
+	unsigned int addr = bank * 84 + x;
+
+	while(len--) // the controller wraps to the next bank like this too
+	{
+		lcdGlass[addr] = *data++;
+		addr = (addr + 1) % sizeof(lcdGlass);
+	}
+}
+
+void halLcdFlush()
+{
+}
+
+void simPrintScreen()
+{
+	printf("--- %lu ms\n", simTime);
+	for(unsigned char y = 0; y < 48; y++)
+	{
+		char line[85];
+		for(unsigned char x = 0; x < 84; x++)
+		{
+			line[x] = (lcdGlass[(y >> 3) * 84 + x] & (1 << (y & 7))) ? '#' : '.';
+		}
+		line[84] = 0;
+		puts(line);
+	}
+}
+// DISPLAY END
+
+// SERIAL BEGIN
+FILE *simSerial = 0;
+
+void halSerialInit(unsigned long baud)
+{
+}
+
+unsigned char halSerialWrite(const unsigned char *data, unsigned char len)
+{
+	if(simSerial)
+	{
+		fwrite(data, 1, len, simSerial);
+	}
+	return 1;
+}
+// SERIAL END
+
+// REPLAY BEGIN
+FILE *simRecord = 0; // -r
+FILE *simReplay = 0; // -p
+FILE *simSums = 0; // -k
+FILE *simCheck = 0; // -K
+unsigned long simChecked = 0; // ticks compared against -K
+
+FILE *simOpenRecording(const char *path, const char *mode)
+{
+	FILE *f = fopen(path, mode);
+	char magic[REPLAY_MAGIC_LEN];
+
+	if(!f)
+	{
+		perror(path);
+		exit(1);
+	}
+	if(mode[0] == 'w')
+	{
+		fwrite(REPLAY_MAGIC, 1, REPLAY_MAGIC_LEN, f);
+	}
+	else if(fread(magic, 1, REPLAY_MAGIC_LEN, f) != REPLAY_MAGIC_LEN || memcmp(magic, REPLAY_MAGIC, REPLAY_MAGIC_LEN))
+	{
+		fprintf(stderr, "%s: not an input recording\n", path);
+		exit(1);
+	}
+	return f;
+}
+
+void halRecordWrite(const unsigned char *data, unsigned char len)
+{
+	if(simRecord)
+	{
+		fwrite(data, 1, len, simRecord);
+	}
+}
+
+unsigned char halReplayRead(unsigned char *data, unsigned char len)
+{
+	if(!simReplay)
+	{
+		return 0;
+	}
+	if(fread(data, 1, len, simReplay) != len)
+	{
+		return 0; // kept open, a checkpoint may go back into it
+	}
+
+	int next = getc(simReplay);
+	if(next == EOF) // last record, stop once its ticks have been played
+	{
+		unsigned long end = simTime + data[2] * simPeriod;
+		if(end < simEnd)
+		{
+			simEnd = end;
+		}
+	}
+	else
+	{
+		ungetc(next, simReplay);
+	}
+	return 1;
+}
+
+void halChecksum(unsigned long tick, unsigned short sum)
+{
+	unsigned char bytes[2] = {sum & 0xFF, sum >> 8};
+
+	if(simSums)
+	{
+		fseek(simSums, tick * 2, SEEK_SET); // by tick, a rewound run writes the same entries again
+		fwrite(bytes, 1, 2, simSums);
+	}
+	if(simCheck)
+	{
+		unsigned char want[2];
+		fseek(simCheck, tick * 2, SEEK_SET);
+		if(fread(want, 1, 2, simCheck) != 2)
+		{
+			fclose(simCheck);
+			simCheck = 0; // ran longer than the reference, nothing left to compare
+			return;
+		}
+		if(memcmp(want, bytes, 2))
+		{
+			fprintf(stderr, "checksum mismatch at tick %lu (%lu ms): %04x, expected %04x\n", tick, simTime, sum, want[0] | (want[1] << 8));
+			exit(1);
+		}
+		simChecked++;
+	}
+}
+
+// -c: the input position goes back with the game, so the ticks after the
+// checkpoint see the same inputs again
+unsigned long simCheckpointAt = 0; // tick to take it after
+unsigned long simRewindAt = 0; // tick to go back after
+unsigned char simCheckpointState = 0; // 0 - none asked for, 1 - waiting, 2 - taken, 3 - gone back
+struct {
+	unsigned long time;
+	unsigned long waits;
+	unsigned int scriptNext;
+	unsigned char joy[HAL_JOY_SLOTS];
+	unsigned char buttons;
+	long replayAt;
+} simSaved;
+
+unsigned char halCheckpoint(unsigned long tick)
+{
+	if(simCheckpointState == 1 && tick == simCheckpointAt)
+	{
+		simSaved.time = simTime;
+		simSaved.waits = simWaits;
+		simSaved.scriptNext = simScriptNext;
+		memcpy(simSaved.joy, simJoy, sizeof(simJoy));
+		simSaved.buttons = simButtons;
+		simSaved.replayAt = simReplay ? ftell(simReplay) : 0;
+		simCheckpointState = 2;
+		return HAL_CHECKPOINT_TAKE;
+	}
+	if(simCheckpointState == 2 && tick == simRewindAt)
+	{
+		simTime = simSaved.time;
+		simWaits = simSaved.waits;
+		simScriptNext = simSaved.scriptNext;
+		memcpy(simJoy, simSaved.joy, sizeof(simJoy));
+		simButtons = simSaved.buttons;
+		if(simReplay)
+		{
+			fseek(simReplay, simSaved.replayAt, SEEK_SET);
+		}
+		simCheckpointState = 3;
+		fprintf(stderr, "back to the checkpoint of tick %lu after tick %lu\n", simCheckpointAt, tick);
+		return HAL_CHECKPOINT_RESTORE;
+	}
+	return 0;
+}
+
+void simReplayEnd()
+{
+	if(simReplay)
+	{
+		fclose(simReplay);
+	}
+	if(simRecord)
+	{
+		fclose(simRecord);
+	}
+	if(simSums)
+	{
+		fclose(simSums);
+	}
+	if(simChecked)
+	{
+		fprintf(stderr, "%lu ticks match the checksum log\n", simChecked);
+	}
+}
+// REPLAY END
+
+int main(int argc, char **argv)
+{
+	int opt;
+	unsigned char endSet = 0;
+
+	while((opt = getopt(argc, argv, "n:i:e:st:r:p:k:K:o:c:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n': simEnd = strtoul(optarg, 0, 10); endSet = 1; break;
+			case 'i': simLoadScript(optarg); break;
+			case 'e': simEvery = strtoul(optarg, 0, 10); break;
+			case 's': simShowEnd = 1; break;
+			case 'o': simOverrun = strtoul(optarg, 0, 10); break;
+			case 'c':
+				if(sscanf(optarg, "%lu,%lu", &simCheckpointAt, &simRewindAt) != 2 || simRewindAt <= simCheckpointAt)
+				{
+					fprintf(stderr, "-c wants two ticks, the checkpoint's first\n");
+					return 2;
+				}
+				simCheckpointState = 1;
+				break;
+			case 't':
+				simSerial = fopen(optarg, "wb");
+				if(!simSerial)
+				{
+					perror(optarg);
+					return 1;
+				}
+				break;
+			case 'r': simRecord = simOpenRecording(optarg, "wb"); break;
+			case 'p': simReplay = simOpenRecording(optarg, "rb"); break;
+			case 'k':
+				simSums = fopen(optarg, "wb");
+				if(!simSums)
+				{
+					perror(optarg);
+					return 1;
+				}
+				break;
+			case 'K':
+				simCheck = fopen(optarg, "rb");
+				if(!simCheck)
+				{
+					perror(optarg);
+					return 1;
+				}
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n ms] [-i script] [-e ms] [-s] [-t file] [-r file] [-p file] [-k file] [-K file] [-o n] [-c a,b]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if(simRecord && simCheckpointState)
+	{
+		fprintf(stderr, "-c rewinds the inputs, it cannot record them with -r\n");
+		return 2;
+	}
+	if(simReplay && !endSet)
+	{
+		simEnd = (unsigned long)-1; // the recording decides
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &simStart);
+	return gameMain();
+}
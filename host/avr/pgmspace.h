@@ -0,0 +1,19 @@
+/*
+ * Stand-in for avr-libc's <avr/pgmspace.h> on the Linux build: flash and RAM
+ * are the same address space there, so PROGMEM data is read directly.
+ */
+
+#ifndef HOST_PGMSPACE_H
+#define HOST_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define memcpy_P memcpy
+
+#endif
@@ -4,715 +4,1407 @@
  * Display: 
  */ 
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#ifndef F_CPU
-#define F_CPU 16000000UL
+#ifdef TELEMETRY
+#define HAL_SERIAL
 #endif
-#include <util/delay.h>
+#ifdef SIM_BENCH
+#define PROFILE
+#define HAL_SERIAL
+#endif
+#ifdef ENEMY_BENCH
+#define HAL_SERIAL // the results go out on USART0 too
+#endif
+#ifdef HAL_SERIAL
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200
+#endif
+#define SERIAL_INIT() halSerialInit(SERIAL_BAUD) // USART0, telemetry frames and the bench reports
+#else
+#define SERIAL_INIT()
+#endif
+#define HAL_TICK_MS 10 // scheduler tick, every task period is a multiple of it (checked in SCHEDULER)
 
-#include "nokia5110.c"
+#include <string.h>
 
-// TIMING BEGIN
-volatile unsigned char TimerFlag = 0; // TimerISR() sets this to 1. C programmer should clear to 0.
+#include "hal.h"
+#ifdef HAL_LINUX
+#include "hal_linux.c"
+#else
+#include "hal_avr.c"
+#endif
+#include "telemetry.h"
+#include "replay.h"
+#include "screens.h" // generated by tools/mkscreens.c
+#include "sprites.h" // generated by tools/mksprites.c
+#ifndef SPRITE_MAX_WIDTH
+#error "sprites.h is out of date, regenerate it with tools/mksprites.c"
+#endif
 
-// Internal variables for mapping AVR's ISR to our cleaner TimerISR model.
-unsigned long _avr_timer_M = 1; // Start count from here, down to 0. Default 1 ms.
-unsigned long _avr_timer_cntcurr = 0; // Current internal count of 1ms ticks
+// PROFILE BEGIN
+// Build with -DPROFILE to time each task and the render with the HAL cycle
+// counter (16 bit, so anything up to ~4 ms at 16 MHz), and to count ticks
+// whose work was still running when the timer fired. Without it the macros
+// below are empty and nothing is compiled in.
+#ifdef PROFILE
+typedef struct profile {
+	unsigned short min; // cycles
+	unsigned short max; // cycles
+	unsigned long total; // cycles, average = total / count
+	unsigned long count;
+} profile;
 
-void TimerOn() {
-	// AVR timer/counter controller register TCCR1
-	TCCR1B = 0x0B;// bit3 = 0: CTC mode (clear timer on compare)
-	// bit2bit1bit0=011: pre-scaler /64
-	// 00001011: 0x0B
-	// SO, 8 MHz clock or 8,000,000 /64 = 125,000 ticks/s
-	// Thus, TCNT1 register will count at 125,000 ticks/s
+unsigned long tickOverruns; // ticks where TimerFlag was already set when the work finished
+profile renderProfile; // lcdRender() at the end of each tick
+profile tickProfile; // inputLatch() and every task due in the tick, render excluded
+profile enemyMoveProfile; // enemyMoveAll(), collision included
+profile bulletHitProfile; // bulletHit() lookups of player 1's bullet
+profile sleepProfile; // halSleepShare() of each tick, in 1/1000 instead of cycles - min is the worst headroom
+profile latencyProfile; // halTickLatency() of each tick, max - min is the tick jitter
+profile transitionProfile; // smStep() actions, every transition a table driven machine takes
 
-	// AVR output compare register OCR1A.
-	OCR1A = 125;	// Timer interrupt will be generated when TCNT1==OCR1A
-	// We want a 1 ms tick. 0.001 s * 125,000 ticks/s = 125
-	// So when TCNT1 register equals 125,
-	// 1 ms has passed. Thus, we compare to 125.
-	// AVR timer interrupt mask register
-	TIMSK1 = 0x02; // bit1: OCIE1A -- enables compare match interrupt
+void profileRecord(profile *p, unsigned short cycles)
+{
+	if(p->count == 0 || cycles < p->min)
+	{
+		p->min = cycles;
+	}
+	if(cycles > p->max)
+	{
+		p->max = cycles;
+	}
+	p->total += cycles;
+	p->count++;
+}
 
-	//Initialize avr counter
-	TCNT1=0;
+#define PROFILE_INIT() halCyclesInit()
+#define PROFILE_BEGIN(start) unsigned short start = halCycles()
+#define PROFILE_END(start, p) profileRecord(&(p), halCycles() - (start))
+#define PROFILE_OVERRUN() if(TimerFlag) { tickOverruns++; }
+#define PROFILE_SLEEP() profileRecord(&sleepProfile, halSleepShare()); profileRecord(&latencyProfile, halTickLatency())
+#else
+#define PROFILE_INIT()
+#define PROFILE_BEGIN(start)
+#define PROFILE_END(start, p)
+#define PROFILE_OVERRUN()
+#define PROFILE_SLEEP()
+#endif
+// PROFILE END
 
-	_avr_timer_cntcurr = _avr_timer_M;
-	// TimerISR will be called every _avr_timer_cntcurr milliseconds
+// EVENTS BEGIN
+// What one machine does that another has to react to (a game starting or
+// ending, a ship being hit, a reset) is posted as an event instead of being
+// left in a variable for the others to poll. Events go through a single
+// producer, single consumer ring: only the producer writes head and only the
+// consumer writes tail, one byte each, so neither has to lock the other out
+// and an interrupt handler can be the producer of a ring of its own. Here the
+// tasks post and gameStep() takes: at the start of every tick it hands each
+// event to the inbox of every task listening for it (SCHEDULER), so an event
+// is seen by every one of its listeners on the next tick.
+#define EVENT_RING_SIZE 16 // power of two, far more than a tick posts
+#define EVENT_BIT(e) (1 << (e))
 
-	//Enable global interrupts
-	SREG |= 0x80; // 0x80: 1000000
-}
+enum Events {eventGameStart, eventGameOver, eventP1Hit, eventP2Hit, eventReset};
 
-void TimerOff() {
-	TCCR1B = 0x00; // bit3bit1bit0=000: timer off
-}
+typedef struct eventRing {
+	volatile unsigned char buf[EVENT_RING_SIZE];
+	volatile unsigned char head; // next slot to write, producer only
+	volatile unsigned char tail; // next slot to read, consumer only
+} eventRing;
 
-void TimerISR() {
-	TimerFlag = 1;
-}
+eventRing gameEvents; // posted by the tasks, taken by gameStep()
+unsigned char taskEvents; // EVENT_BIT()s delivered to the task running now
 
-// In our approach, the C programmer does not touch this ISR, but rather TimerISR()
-ISR(TIMER1_COMPA_vect) {
-	// CPU automatically calls when TCNT1 == OCR1 (every 1 ms per TimerOn settings)
-	_avr_timer_cntcurr--; // Count down to 0 rather than up to TOP
-	if (_avr_timer_cntcurr == 0) { // results in a more efficient compare
-		TimerISR(); // Call the ISR that the user uses
-		_avr_timer_cntcurr = _avr_timer_M;
+unsigned char eventPost(eventRing *r, unsigned char e) // 0 if the ring is full
+{
+	unsigned char head = r->head;
+	
+	if((unsigned char)(head - r->tail) >= EVENT_RING_SIZE)
+	{
+		return 0;
 	}
+	r->buf[head & (EVENT_RING_SIZE - 1)] = e;
+	r->head = head + 1; // publish after the slot is written
+	return 1;
 }
 
-// Set TimerISR() to tick every M ms
-void TimerSet(unsigned long M) {
-	_avr_timer_M = M;
-	_avr_timer_cntcurr = _avr_timer_M;
+unsigned char eventTake(eventRing *r, unsigned char *e) // 0 if the ring is empty
+{
+	unsigned char tail = r->tail;
+	
+	if(tail == r->head)
+	{
+		return 0;
+	}
+	*e = r->buf[tail & (EVENT_RING_SIZE - 1)];
+	r->tail = tail + 1; // free the slot after it is read
+	return 1;
 }
-// TIMING END
+// EVENTS END
 
 
 // JOYSTICK BEGIN
-void InitADC(void)
+// Inputs are sampled once per scheduler tick by inputLatch() (REPLAY section),
+// so every task in a tick sees the same inputs and a recording can stand in
+// for the hardware. Joystick readings are 0-255 with ~128 centered, so
+// 150/75 are the old 600/300 thresholds of the 10 bit ADC. A reading older
+// than JOY_STALE ticks reads as centered: the scan takes well under a tick,
+// so an old one means the ADC stopped and the stick would otherwise stay held.
+#ifndef JOY_STALE
+#define JOY_STALE 5 // ticks
+#endif
+
+unsigned short inputWord; // INPUT_* bits (replay.h) for this tick
+
+unsigned char joystickRead(unsigned char slot)
 {
-	ADMUX|=(1<<REFS0);
-	ADCSRA|=(1<<ADEN)|(1<<ADPS0)|(1<<ADPS1)|(1<<ADPS2); //ENABLE ADC, PRESCALER 128
+	if(halJoystickAge(slot) > JOY_STALE)
+	{
+		return 0x80;
+	}
+	return halJoystick(slot);
 }
 
-uint16_t readadc(uint8_t ch)
+unsigned short inputRead()
 {
-	ch&=0b00000111;         //ANDing to limit input to 7
-	ADMUX = (ADMUX & 0xf8)|ch;  //Clear last 3 bits of ADMUX, OR with ch
-	ADCSRA|=(1<<ADSC);        //START CONVERSION
-	while((ADCSRA)&(1<<ADSC));    //WAIT UNTIL CONVERSION IS COMPLETE
-	return(ADC);        //RETURN ADC VALUE
+	unsigned short word = 0;
+	unsigned char buttons = halButtons();
+	unsigned char y = joystickRead(HAL_JOY_Y);
+	unsigned char x = joystickRead(HAL_JOY_X);
+	unsigned char x2 = joystickRead(HAL_JOY2_X);
+	
+	if(y > 150) word |= INPUT_UP;
+	if(y < 75) word |= INPUT_DOWN;
+	if(x < 75) word |= INPUT_LEFT;
+	if(x > 150) word |= INPUT_RIGHT;
+	if(x2 < 75) word |= INPUT_LEFT2;
+	if(x2 > 150) word |= INPUT_RIGHT2;
+	if(buttons & HAL_BUTTON_SHOOT) word |= INPUT_SHOOT;
+	if(buttons & HAL_BUTTON_SHOOT2) word |= INPUT_SHOOT2;
+	if(buttons & HAL_BUTTON_RESET) word |= INPUT_RESET;
+	return word;
 }
-#define buttonUp (readadc(0) > 600)
-#define buttonDown (readadc(0) < 300)
-#define buttonRight (readadc(1) > 600)
-#define buttonLeft (readadc(1) < 300)
-#define buttonShoot (~PINB & 0x01)
-#define buttonShoot2 (~PINB & 0x02)
-#define buttonRight2 (readadc(4) > 600)
-#define buttonLeft2 (readadc(4) < 300)
-#define buttonReset (~PINB & 0x04)
-// JOYSTICK END
-
-// game state
-unsigned char playingGame;
-unsigned char winLose = 0;
-unsigned char cnt = 0;
-const unsigned char displayTime = 10; // .050 sec period - 5 seconds
-unsigned doReset;
-
-// ship
-const unsigned char maxX = 81; // 84x48
-const unsigned char minX = 3;
-const unsigned char initX = 41;
-unsigned char xPosition; // input/output
-
-// bullet
-signed char bulletXPos; // output/input
-signed char bulletYPos; // output/input
-const unsigned char bulletMaxY = 46; // 84x48
-const unsigned char bulletInitY = 4;
-unsigned char bulletLife;
-
-// enemy states
-const unsigned char enemyNumber = 10;
-unsigned char enemyAlive[10]; // initialize all to one
-unsigned char enemyRL[10]; // initialize all to one
-unsigned char enemyLeft; //initialize to enemy number - win condition if == 0
-
-// enemy positions
-unsigned char enemyXPos[10]; // input <- size of enemyNumber
-unsigned char enemyYPos[10]; // input <- size of enemyNumber
-const unsigned char maxXEnemy = 80;
-const unsigned char minXEnemy = 3;
-const unsigned char minYEnemy = 4;
-
-// player 2
-unsigned const char maxX2 = 81; // 84x48
-unsigned const char minX2 = 3;
-unsigned const char initX2 = 40;
-unsigned char xPosition2; // input/output
 
-const unsigned char bulletInitY2 = 43;
-const unsigned char maxY2 = 1; // 84x48
+#define buttonUp (inputWord & INPUT_UP)
+#define buttonDown (inputWord & INPUT_DOWN)
+#define buttonRight (inputWord & INPUT_RIGHT)
+#define buttonLeft (inputWord & INPUT_LEFT)
+#define buttonShoot (inputWord & INPUT_SHOOT)
+#define buttonShoot2 (inputWord & INPUT_SHOOT2)
+#define buttonRight2 (inputWord & INPUT_RIGHT2)
+#define buttonLeft2 (inputWord & INPUT_LEFT2)
+#define buttonReset (inputWord & INPUT_RESET)
+// JOYSTICK END
 
-unsigned char bulletXPos2; // output/input
-unsigned char bulletYPos2; // output/input
+// DISPLAY BEGIN
+// Dirty tracking on top of the lcdScreen framebuffer. Game code draws through
+// lcdSetPixel()/lcdWriteString()/lcdClear(), which flag every (bank, column)
+// byte that actually changed. lcdRender() then points the LCD at each dirty
+// run and sends only those bytes instead of all 504.
+#define LCD_WIDTH 84
+#define LCD_HEIGHT 48
+#define LCD_BANKS 6 // 8 pixel tall rows, one framebuffer byte per column
+#define SPRITE_DRAW 0 // OR into the framebuffer
+#define SPRITE_ERASE 1 // AND the inverted mask into the framebuffer
+#define SPRITE_XOR 2
+#define LCD_DIRTY_GAP 3 // re-addressing costs 2 bytes, so clean gaps shorter than this are resent
 
-unsigned playerWin;
-unsigned player2Win;
+unsigned char lcdDirty[LCD_BANKS][(LCD_WIDTH + 7) / 8]; // one bit per framebuffer byte
+unsigned short lcdBytesFrame; // bytes (commands + data) sent by the last lcdRender()
+unsigned long lcdBytesTotal; // bytes sent since power on
+unsigned long lcdFrames; // lcdRender() calls
+unsigned long lcdRenderSkips; // lcdRender() calls put off while the backend was still sending
+unsigned char lcdCursorX; // where lcdWriteString() writes next
+unsigned char lcdCursorY;
 
+void lcdSetCursor(unsigned char x, unsigned char y)
+{
+	lcdCursorX = x;
+	lcdCursorY = y;
+}
 
-char playerHit2(unsigned char xCoor, unsigned char yCoor) // hitbox/hurtbox setup
+void lcdSetPixel(unsigned char x, unsigned char y, unsigned char value)
 {
-	if(xCoor == bulletXPos) // middle column
+	if(x >= LCD_WIDTH || y >= LCD_HEIGHT) // off screen (negative coordinates wrap to here too)
 	{
-		if(yCoor == bulletYPos) // middle row
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos) // "top" row
-		{
-			return 1;
-		}
+		return;
 	}
-	else if((xCoor - 1) == bulletXPos) // left column
+	
+	unsigned char bank = y >> 3;
+	unsigned char *byte = &lcdScreen[bank * LCD_WIDTH + x];
+	unsigned char old = *byte;
+	
+	if(value)
 	{
-		if(yCoor == bulletYPos) // middle row
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
+		*byte = old | (1 << (y & 7));
 	}
-	else if((xCoor + 1) == bulletXPos) // right column
+	else
 	{
-		if(yCoor == bulletYPos) // middle row
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
+		*byte = old & ~(1 << (y & 7));
 	}
-	else if((xCoor + 2) == bulletXPos) // right column
+	
+	if(*byte != old)
 	{
-		if((yCoor + 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
+		lcdDirty[bank][x >> 3] |= 1 << (x & 7);
 	}
-	else if((xCoor - 2) == bulletXPos) // right column
+}
+
+void lcdClear(void)
+{
+	for(unsigned char bank = 0; bank < LCD_BANKS; bank++)
 	{
-		if((yCoor + 1) == bulletYPos) // "bottom row"
+		unsigned char *row = &lcdScreen[bank * LCD_WIDTH];
+		for(unsigned char x = 0; x < LCD_WIDTH; x++)
 		{
-			return 1;
+			if(row[x])
+			{
+				row[x] = 0;
+				lcdDirty[bank][x >> 3] |= 1 << (x & 7);
+			}
 		}
 	}
-	
-	return 0;
+	lcdSetCursor(0, 0);
 }
 
-char playerHit(unsigned char xCoor, unsigned char yCoor) // hitbox/hurtbox setup
+void lcdMarkSpan(int bank, int x0, int x1) // flag columns x0..x1 of a bank as dirty
 {
-	if(xCoor == bulletXPos2) // middle column
+	if(bank < 0 || bank >= LCD_BANKS)
 	{
-		if(yCoor == bulletYPos2) // middle row
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos2) // "bottom row"
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos2) // "top" row
-		{
-			return 1;
-		}
+		return;
 	}
-	else if((xCoor - 1) == bulletXPos2) // left column
+	if(x0 < 0)
 	{
-		if(yCoor == bulletYPos2) // middle row
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos2) // "bottom row"
-		{
-			return 1;
-		}
+		x0 = 0;
 	}
-	else if((xCoor + 1) == bulletXPos2) // right column
+	if(x1 >= LCD_WIDTH)
 	{
-		if(yCoor == bulletYPos2) // middle row
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos2) // "bottom row"
-		{
-			return 1;
-		}
+		x1 = LCD_WIDTH - 1;
 	}
-	else if((xCoor + 2) == bulletXPos2) // right column
+	for(int x = x0; x <= x1; x++)
 	{
-		if((yCoor - 1) == bulletYPos2) // "bottom row"
-		{
-			return 1;
-		}
+		lcdDirty[bank][x >> 3] |= 1 << (x & 7);
 	}
-	else if((xCoor - 2) == bulletXPos2) // right column
+}
+
+// same glyph layout as nokia_lcd_write_char(), but through lcdSetPixel()
+void lcdWriteChar(char code, unsigned char scale)
+{
+	for(unsigned char x = 0; x < 5 * scale; x++)
 	{
-		if((yCoor - 1) == bulletYPos2) // "bottom row"
+		unsigned char column = pgm_read_byte(&CHARSET[code - 32][x / scale]);
+		for(unsigned char y = 0; y < 7 * scale; y++)
 		{
-			return 1;
+			lcdSetPixel(lcdCursorX + x, lcdCursorY + y, column & (1 << (y / scale)));
 		}
 	}
 	
-	return 0;
-}
-
-void displayShipInit() // call only when playing game is started
-{
-	// draw ship
-	nokia_lcd_set_pixel(initX - 2, 0, 1); // bottom
-	nokia_lcd_set_pixel(initX - 1, 0, 1);
-	nokia_lcd_set_pixel(initX, 0, 1);
-	nokia_lcd_set_pixel(initX + 1, 0, 1);
-	nokia_lcd_set_pixel(initX + 2, 0, 1);
-	nokia_lcd_set_pixel(initX, 1, 1); // center
-	nokia_lcd_set_pixel(initX - 1, 1, 1); // left
-	nokia_lcd_set_pixel(initX + 1, 1, 1); // right
-	nokia_lcd_set_pixel(initX, 2, 1); // top
-	
-	/*		00000 
-	 *		 000
-	 *		  0	 */
-}
-
-void displayMoveLeft(char xPosition) // call every time ship moves left
-{
-	// erase
-	nokia_lcd_set_pixel(xPosition - 2, 0, 0); // bottom
-	nokia_lcd_set_pixel(xPosition - 1, 0, 0);
-	nokia_lcd_set_pixel(xPosition, 0, 0);
-	nokia_lcd_set_pixel(xPosition + 1, 0, 0);
-	nokia_lcd_set_pixel(xPosition + 2, 0, 0);
-	nokia_lcd_set_pixel(xPosition, 1, 0); // center
-	nokia_lcd_set_pixel(xPosition - 1, 1, 0); // left
-	nokia_lcd_set_pixel(xPosition + 1, 1, 0); // right
-	nokia_lcd_set_pixel(xPosition, 2, 0); // top
-	
-	// move left
-	nokia_lcd_set_pixel((xPosition - 2) - 1, 0, 1); // bottom
-	nokia_lcd_set_pixel((xPosition - 1) - 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition) - 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition + 1) - 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition + 2) - 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition) - 1, 1, 1); // center
-	nokia_lcd_set_pixel((xPosition - 1) - 1, 1, 1); // left
-	nokia_lcd_set_pixel((xPosition + 1) - 1, 1, 1); // right
-	nokia_lcd_set_pixel((xPosition) - 1, 2, 1); // top
-}
-
-void displayMoveRight(char xPosition) // call every time ship moves left
-{
-	// erase
-	nokia_lcd_set_pixel(xPosition - 2, 0, 0); // bottom
-	nokia_lcd_set_pixel(xPosition - 1, 0, 0);
-	nokia_lcd_set_pixel(xPosition, 0, 0);
-	nokia_lcd_set_pixel(xPosition + 1, 0, 0);
-	nokia_lcd_set_pixel(xPosition + 2, 0, 0);
-	nokia_lcd_set_pixel(xPosition, 1, 0); // center
-	nokia_lcd_set_pixel(xPosition - 1, 1, 0); // left
-	nokia_lcd_set_pixel(xPosition + 1, 1, 0); // right
-	nokia_lcd_set_pixel(xPosition, 2, 0); // top
-	
-	// move left
-	nokia_lcd_set_pixel((xPosition - 2) + 1, 0, 1); // bottom
-	nokia_lcd_set_pixel((xPosition - 1) + 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition) + 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition + 1) + 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition + 2) + 1, 0, 1);
-	nokia_lcd_set_pixel((xPosition) + 1, 1, 1); // center
-	nokia_lcd_set_pixel((xPosition + 1) - 1, 1, 1); // left
-	nokia_lcd_set_pixel((xPosition + 1) + 1, 1, 1); // right
-	nokia_lcd_set_pixel((xPosition) + 1, 2, 1); // top
-}
-
-// player 2
-void displayShipInit2() // call only when playing game is started
-{
-	// draw ship
-	nokia_lcd_set_pixel(initX2 - 2, 47, 1); // bottom
-	nokia_lcd_set_pixel(initX2 - 1, 47, 1);
-	nokia_lcd_set_pixel(initX2, 47, 1);
-	nokia_lcd_set_pixel(initX2 + 1, 47, 1);
-	nokia_lcd_set_pixel(initX2 + 2, 47, 1);
-	nokia_lcd_set_pixel(initX2, 46, 1); // center
-	nokia_lcd_set_pixel(initX2 - 1, 46, 1); // left
-	nokia_lcd_set_pixel(initX2 + 1, 46, 1); // right
-	nokia_lcd_set_pixel(initX2, 45, 1); // top
-	
-	/*		00000 
-	 *		 000
-	 *		  0	 */
-}
-
-void displayMoveLeft2(char xPosition) // call every time ship moves left
-{
-	// erase
-	nokia_lcd_set_pixel(xPosition2 - 2, 47, 0); // bottom
-	nokia_lcd_set_pixel(xPosition2 - 1, 47, 0);
-	nokia_lcd_set_pixel(xPosition2, 47, 0);
-	nokia_lcd_set_pixel(xPosition2 + 1, 47, 0);
-	nokia_lcd_set_pixel(xPosition2 + 2, 47, 0);
-	nokia_lcd_set_pixel(xPosition2, 46, 0); // center
-	nokia_lcd_set_pixel(xPosition2 - 1, 46, 0); // left
-	nokia_lcd_set_pixel(xPosition2 + 1, 46, 0); // right
-	nokia_lcd_set_pixel(xPosition2, 45, 0); // top
-	
-	// move left
-	nokia_lcd_set_pixel((xPosition2 - 2) - 1, 47, 1); // bottom
-	nokia_lcd_set_pixel((xPosition2 - 1) - 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2) - 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2 + 1) - 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2 + 2) - 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2) - 1, 46, 1); // center
-	nokia_lcd_set_pixel((xPosition2 - 1) - 1, 46, 1); // left
-	nokia_lcd_set_pixel((xPosition2 + 1) - 1, 46, 1); // right
-	nokia_lcd_set_pixel((xPosition2) - 1, 45, 1); // top
-}
-
-void displayMoveRight2(char xPosition) // call every time ship moves left
-{
-	// erase
-	nokia_lcd_set_pixel(xPosition2 - 2, 47, 0); // bottom
-	nokia_lcd_set_pixel(xPosition2 - 1, 47, 0);
-	nokia_lcd_set_pixel(xPosition2, 47, 0);
-	nokia_lcd_set_pixel(xPosition2 + 1, 47, 0);
-	nokia_lcd_set_pixel(xPosition2 + 2, 47, 0);
-	nokia_lcd_set_pixel(xPosition2, 46, 0); // center
-	nokia_lcd_set_pixel(xPosition2 - 1, 46, 0); // left
-	nokia_lcd_set_pixel(xPosition2 + 1, 46, 0); // right
-	nokia_lcd_set_pixel(xPosition2, 45, 0); // top
-	
-	// move left
-	nokia_lcd_set_pixel((xPosition2 - 2) + 1, 47, 1); // bottom
-	nokia_lcd_set_pixel((xPosition2 - 1) + 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2) + 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2 + 1) + 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2 + 2) + 1, 47, 1);
-	nokia_lcd_set_pixel((xPosition2) + 1, 46, 1); // center
-	nokia_lcd_set_pixel((xPosition2 - 1) + 1, 46, 1); // left
-	nokia_lcd_set_pixel((xPosition2 + 1) + 1, 46, 1); // right
-	nokia_lcd_set_pixel((xPosition2) + 1, 45, 1); // top
-}
-
-
-void eraseBullet(char bulletXPos, char bulletYPos)
-{
-	nokia_lcd_set_pixel(bulletXPos, bulletYPos + 1, 0); // top		|
-	nokia_lcd_set_pixel(bulletXPos, bulletYPos, 0); // center	|
-	nokia_lcd_set_pixel(bulletXPos, bulletYPos - 1, 0); // bottom	|
-}
-
-void displayBullet(char bulletXPos, char bulletYPos)
-{
-	nokia_lcd_set_pixel(bulletXPos, bulletYPos + 1, 1); // top		|
-	nokia_lcd_set_pixel(bulletXPos, bulletYPos, 1); // center	|
-	nokia_lcd_set_pixel(bulletXPos, bulletYPos - 1, 1); // bottom	|
+	lcdCursorX += 5 * scale + 1;
+	if(lcdCursorX >= LCD_WIDTH)
+	{
+		lcdCursorX = 0;
+		lcdCursorY += 7 * scale + 1;
+	}
+	if(lcdCursorY >= LCD_HEIGHT)
+	{
+		lcdCursorX = 0;
+		lcdCursorY = 0;
+	}
 }
 
-void enemyInit()
+void lcdWriteString(const char *str, unsigned char scale)
 {
-	enemyXPos[0] = 3;
-	enemyXPos[1] = 10;
-	enemyXPos[2] = 17;
-	enemyXPos[3] = 24;
-	enemyXPos[4] = 31;
-	enemyXPos[5] = 38;
-	enemyXPos[6] = 45;
-	enemyXPos[7] = 52;
-	enemyXPos[8] = 59;
-	enemyXPos[9] = 66;
-	// enemyXPos[10] = 73;
-	// enemyXPos[11] = 80; // 12 enemies
-	
-	for(int i = 0; i < enemyNumber; i++)
-	{
-		enemyYPos[i] = 45;
-		enemyRL[i] = 1; // 1 - left, 0 - right
-		enemyAlive[i] = 1;
-		
-		nokia_lcd_set_pixel(enemyXPos[i] - 1, 46, 1);	// top row
-		nokia_lcd_set_pixel(enemyXPos[i], 46, 1);
-		nokia_lcd_set_pixel(enemyXPos[i] + 1, 46, 1);
-		nokia_lcd_set_pixel(enemyXPos[i] - 1, 45, 1);		// mid row
-		nokia_lcd_set_pixel(enemyXPos[i], 45, 1);
-		nokia_lcd_set_pixel(enemyXPos[i] + 1, 45, 1);
-		nokia_lcd_set_pixel(enemyXPos[i] - 1, 44, 1);	// bottom row
-		//nokia_lcd_set_pixel(enemyXPos[i], 44, 1);
-		nokia_lcd_set_pixel(enemyXPos[i] + 1, 44, 1);
+	while(*str)
+	{
+		lcdWriteChar(*str++, scale);
 	}
 }
 
-void enemyEraseAll()
+// Replace the whole screen with a run length coded PROGMEM image from
+// screens.h, flagging only the bytes that differ from what is shown.
+void screenDraw(const unsigned char *image)
 {
-	for(int i = 0; i < enemyNumber; i++)
+	unsigned char *byte = lcdScreen;
+	unsigned char bank = 0;
+	unsigned char x = 0;
+	
+	while(bank < LCD_BANKS)
 	{
-		if(enemyAlive[i])
+		unsigned char c = pgm_read_byte(image++);
+		unsigned char literal = !(c & 0x80);
+		unsigned char count = literal ? c + 1 : (c & 0x7F) + 2;
+		unsigned char value = 0;
+		
+		for(unsigned char i = 0; i < count && bank < LCD_BANKS; i++)
 		{
-			nokia_lcd_set_pixel(enemyXPos[i] - 1, enemyYPos[i] + 1, 0);	// top row
-			nokia_lcd_set_pixel(enemyXPos[i], enemyYPos[i] + 1, 0);
-			nokia_lcd_set_pixel(enemyXPos[i] + 1, enemyYPos[i] + 1, 0);
-			nokia_lcd_set_pixel(enemyXPos[i] - 1, enemyYPos[i], 0);		// mid row
-			nokia_lcd_set_pixel(enemyXPos[i], enemyYPos[i], 0);
-			nokia_lcd_set_pixel(enemyXPos[i] + 1, enemyYPos[i], 0);
-			nokia_lcd_set_pixel(enemyXPos[i] - 1, enemyYPos[i] - 1, 0);	// bottom row
-			//nokia_lcd_set_pixel(enemyXPos[i], enemyYPos[i] - 1, 0);
-			nokia_lcd_set_pixel(enemyXPos[i] + 1, enemyYPos[i] - 1, 0);
+			if(literal || i == 0)
+			{
+				value = pgm_read_byte(image++);
+			}
+			if(*byte != value)
+			{
+				*byte = value;
+				lcdDirty[bank][x >> 3] |= 1 << (x & 7);
+			}
+			byte++;
+			if(++x == LCD_WIDTH)
+			{
+				x = 0;
+				bank++;
+			}
 		}
 	}
+	lcdSetCursor(0, 0);
 }
 
-void enemyEraseIndv(char xCoor, char yCoor)
-{
-	nokia_lcd_set_pixel(xCoor - 1, yCoor + 1, 0);	// top row
-	nokia_lcd_set_pixel(xCoor, yCoor + 1, 0);
-	nokia_lcd_set_pixel(xCoor + 1, yCoor + 1, 0);
-	nokia_lcd_set_pixel(xCoor - 1, yCoor, 0);		// mid row
-	nokia_lcd_set_pixel(xCoor, yCoor, 0);
-	nokia_lcd_set_pixel(xCoor + 1, yCoor, 0);
-	nokia_lcd_set_pixel(xCoor - 1, yCoor - 1, 0);	// bottom row
-	//nokia_lcd_set_pixel(xCoor, yCoor - 1, 0);
-	nokia_lcd_set_pixel(xCoor + 1, yCoor - 1, 0);
-}
-
-char enemyHit(unsigned char xCoor, unsigned char yCoor) // hitbox/hurtbox setup
+void lcdRender(void)
 {
-	if(xCoor == bulletXPos) // middle column
+	unsigned short sent = 0;
+	
+	if(halLcdBusy()) // last frame still going out; the dirty spans wait for the next tick
 	{
-		if(yCoor == bulletYPos) // middle row
-		{
-			return 1;
-		}
-		else if(yCoor == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if(yCoor == (bulletYPos - 1))
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == (bulletYPos - 1))
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos) // "top" row
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == (bulletYPos - 1))
-		{
-			return 1;
-		}
+		lcdRenderSkips++;
+		return;
 	}
-	else if((xCoor - 1) == bulletXPos) // left column
+	
+	for(unsigned char bank = 0; bank < LCD_BANKS; bank++)
 	{
-		if(yCoor == bulletYPos) // middle row
-		{
-			return 1;
-		}
-		else if(yCoor == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if(yCoor == (bulletYPos - 1))
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == (bulletYPos - 1))
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos) // "top" row
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == (bulletYPos + 1))
+		unsigned char *dirty = lcdDirty[bank];
+		unsigned char *row = &lcdScreen[bank * LCD_WIDTH];
+		unsigned char x = 0;
+		
+		while(x < LCD_WIDTH)
 		{
-			return 1;
+			if(dirty[x >> 3] == 0) // 8 clean columns, skip them at once
+			{
+				x = (x | 7) + 1;
+				continue;
+			}
+			if(!(dirty[x >> 3] & (1 << (x & 7))))
+			{
+				x++;
+				continue;
+			}
+			
+			// grow the run until LCD_DIRTY_GAP clean columns in a row
+			unsigned char start = x;
+			unsigned char end = x;
+			unsigned char gap = 0;
+			for(x++; x < LCD_WIDTH && gap < LCD_DIRTY_GAP; x++)
+			{
+				if(dirty[x >> 3] & (1 << (x & 7)))
+				{
+					end = x;
+					gap = 0;
+				}
+				else
+				{
+					gap++;
+				}
+			}
+			
+			halLcdWrite(bank, start, &row[start], end - start + 1);
+			sent += 2 + (end - start + 1); // address commands + data
 		}
-		else if((yCoor + 1) == (bulletYPos - 1))
+		
+		for(unsigned char i = 0; i < sizeof(lcdDirty[0]); i++)
 		{
-			return 1;
+			dirty[i] = 0;
 		}
 	}
-	else if((xCoor + 1) == bulletXPos) // right column
+	
+	halLcdFlush();
+	
+	lcdBytesFrame = sent;
+	lcdBytesTotal += sent;
+	lcdFrames++;
+}
+// Byte level write into one framebuffer bank; the building block for sprites
+void lcdBlitByte(int x, int bank, unsigned char mask, unsigned char op)
+{
+	if(mask == 0 || x < 0 || x >= LCD_WIDTH || bank < 0 || bank >= LCD_BANKS)
+	{
+		return;
+	}
+	
+	unsigned char *byte = &lcdScreen[bank * LCD_WIDTH + x];
+	unsigned char old = *byte;
+	
+	if(op == SPRITE_DRAW)
 	{
-		if(yCoor == bulletYPos) // middle row
-		{
-			return 1;
-		}
-		else if(yCoor == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if(yCoor == (bulletYPos - 1))
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == bulletYPos) // "bottom row"
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if((yCoor - 1) == (bulletYPos - 1))
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == bulletYPos) // "top" row
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == (bulletYPos + 1))
-		{
-			return 1;
-		}
-		else if((yCoor + 1) == (bulletYPos - 1))
-		{
-			return 1;
-		}
+		*byte = old | mask;
+	}
+	else if(op == SPRITE_ERASE)
+	{
+		*byte = old & ~mask;
+	}
+	else
+	{
+		*byte = old ^ mask;
 	}
 	
-	return 0;
+	if(*byte != old)
+	{
+		lcdDirty[bank][x >> 3] |= 1 << (x & 7);
+	}
 }
+// DISPLAY END
 
+// SPRITES BEGIN
+// Sprites live in flash as: width, height, x offset, y offset of the top left
+// pixel from the anchor, then one byte per column (bit 0 = lowest y). Anchors
+// are the sprite centers, the same points the hitbox checks use.
+// The tables (spriteShip, spriteShip2, spriteEnemy, spriteBullet and the
+// hitboxes below) are generated into sprites.h from assets/sprites.txt by
+// tools/mksprites.c, so art changes do not touch this file.
 
-char bulletHit()
+// OR/AND/XOR whole sprite columns into the framebuffer; a column that
+// straddles two banks is split with one 16 bit shift
+void spriteBlit(const unsigned char *sprite, int x, int y, unsigned char op)
 {
-	for(int i = 0; i < enemyNumber; i++)
+	unsigned char width = pgm_read_byte(&sprite[0]);
+	int left = x + (signed char)pgm_read_byte(&sprite[2]);
+	int top = y + (signed char)pgm_read_byte(&sprite[3]);
+	int bank = top >> 3; // floor, so sprites hanging off the bottom edge clip too
+	unsigned char shift = top & 7;
+	
+	for(unsigned char i = 0; i < width; i++)
 	{
-		if(enemyAlive[i] == 1)
-		{
-			if(enemyHit(enemyXPos[i], enemyYPos[i]) == 1) // change to enemyHit
-			{
-				return 1;
-			}
-		}
+		unsigned short column = pgm_read_byte(&sprite[4 + i]) << shift;
+		lcdBlitByte(left + i, bank, column & 0xFF, op);
+		lcdBlitByte(left + i, bank + 1, column >> 8, op);
 	}
-	return 0;
 }
 
-void enemyMoveAll()
+// Blit one sprite at every set bit of mask, bit i at x + i * dx. The columns
+// are shifted into their banks once for the whole row and the dirty span is
+// flagged once, so a row of invaders costs a few byte ops per invader.
+void spriteBlitRow(const unsigned char *sprite, int x, int y, unsigned char dx, unsigned short mask, unsigned char op)
 {
-	for(int i = 0; i < enemyNumber; i++)
+	unsigned char width = pgm_read_byte(&sprite[0]);
+	int left = x + (signed char)pgm_read_byte(&sprite[2]);
+	int top = y + (signed char)pgm_read_byte(&sprite[3]);
+	int bank = top >> 3;
+	unsigned char shift = top & 7;
+	unsigned char lo[SPRITE_MAX_WIDTH]; // column bits landing in bank
+	unsigned char hi[SPRITE_MAX_WIDTH]; // column bits spilling into bank + 1
+	unsigned char loUsed = 0;
+	unsigned char hiUsed = 0;
+	
+	if(mask == 0)
+	{
+		return;
+	}
+	
+	for(unsigned char i = 0; i < width; i++)
+	{
+		unsigned short column = pgm_read_byte(&sprite[4 + i]) << shift;
+		lo[i] = column & 0xFF;
+		hi[i] = column >> 8;
+		loUsed |= lo[i];
+		hiUsed |= hi[i];
+	}
+	
+	unsigned char *rowLo = (loUsed && bank >= 0 && bank < LCD_BANKS) ? &lcdScreen[bank * LCD_WIDTH] : 0;
+	unsigned char *rowHi = (hiUsed && bank + 1 >= 0 && bank + 1 < LCD_BANKS) ? &lcdScreen[(bank + 1) * LCD_WIDTH] : 0;
+	int first = -1;
+	int last = -1;
+	
+	for(; mask; mask >>= 1, left += dx)
 	{
-		if(enemyAlive[i])
+		if(!(mask & 1))
 		{
-			if(enemyRL[i] == 1 && enemyXPos[i] > minXEnemy) // move left
-			{
-				enemyXPos[i]--;
-			}
-			else if(enemyRL[i] == 1 && enemyXPos[i] <= minXEnemy) // cant move left, move down then set RL to 0
+			continue;
+		}
+		for(unsigned char i = 0; i < width; i++)
+		{
+			int cx = left + i;
+			if(cx < 0 || cx >= LCD_WIDTH)
 			{
-				enemyYPos[i] = enemyYPos[i] - 5;
-				enemyRL[i] = 0;
+				continue;
 			}
-			else if(enemyRL[i] == 0 && enemyXPos[i] < maxXEnemy) // move right
+			if(op == SPRITE_DRAW)
 			{
-				enemyXPos[i]++;
+				if(rowLo) rowLo[cx] |= lo[i];
+				if(rowHi) rowHi[cx] |= hi[i];
 			}
-			else if(enemyRL[i] == 0 && enemyXPos[i] >= maxXEnemy) // // cant move right move down then set RL to 1
+			else if(op == SPRITE_ERASE)
 			{
-				enemyYPos[i] = enemyYPos[i] - 5;
-				enemyRL[i] = 1;
+				if(rowLo) rowLo[cx] &= ~lo[i];
+				if(rowHi) rowHi[cx] &= ~hi[i];
 			}
-			
-			nokia_lcd_set_pixel(enemyXPos[i] - 1, enemyYPos[i] + 1, 1);	// top row
-			nokia_lcd_set_pixel(enemyXPos[i], enemyYPos[i] + 1, 1);
-			nokia_lcd_set_pixel(enemyXPos[i] + 1, enemyYPos[i] + 1, 1);
-			nokia_lcd_set_pixel(enemyXPos[i] - 1, enemyYPos[i], 1);		// mid row
-			nokia_lcd_set_pixel(enemyXPos[i], enemyYPos[i], 1);
-			nokia_lcd_set_pixel(enemyXPos[i] + 1, enemyYPos[i], 1);
-			nokia_lcd_set_pixel(enemyXPos[i] - 1, enemyYPos[i] - 1, 1);	// bottom row
-			//nokia_lcd_set_pixel(enemyXPos[i], enemyYPos[i] - 1, 1);
-			nokia_lcd_set_pixel(enemyXPos[i] + 1, enemyYPos[i] - 1, 1);
-			
-			if(enemyHit(enemyXPos[i], enemyYPos[i]))
+			else
 			{
-				enemyLeft--; // update win condition
-				enemyAlive[i] = 0; // no longer char about this enemy
-				enemyEraseIndv(enemyXPos[i], enemyYPos[i]); // erase from screen - not neccessary?
-				bulletLife = 0;
-				
-				if(enemyLeft <= 0)
-				{
-					winLose = 1;
-					playingGame = 0;
-				}
+				if(rowLo) rowLo[cx] ^= lo[i];
+				if(rowHi) rowHi[cx] ^= hi[i];
 			}
-			else if(enemyYPos[i] <= minYEnemy)
-			{
-				winLose = 0; // lose condition fulfilled
-				playingGame = 0;
+		}
+		if(first < 0)
+		{
+			first = left;
+		}
+		last = left + width - 1;
+	}
+	
+	if(rowLo)
+	{
+		lcdMarkSpan(bank, first, last);
+	}
+	if(rowHi)
+	{
+		lcdMarkSpan(bank + 1, first, last);
+	}
+}
+// SPRITES END
+
+// COLLISION BEGIN
+// Hitboxes use the sprite layout above. hitTest() rejects on the bounding
+// boxes first, then ANDs the overlapping columns with B shifted onto A's rows.
+// hitEnemy (full 3x3, the gap in the sprite still counts) and hitPoint (bullet
+// tip vs ships) come from sprites.h with the sprites.
+
+char hitTest(const unsigned char *a, int ax, int ay, const unsigned char *b, int bx, int by)
+{
+	int aLeft = ax + (signed char)pgm_read_byte(&a[2]);
+	int aTop = ay + (signed char)pgm_read_byte(&a[3]);
+	int bLeft = bx + (signed char)pgm_read_byte(&b[2]);
+	int bTop = by + (signed char)pgm_read_byte(&b[3]);
+	int aRight = aLeft + pgm_read_byte(&a[0]);
+	int bRight = bLeft + pgm_read_byte(&b[0]);
+	
+	if(bLeft >= aRight || aLeft >= bRight
+		|| bTop >= aTop + pgm_read_byte(&a[1]) || aTop >= bTop + pgm_read_byte(&b[1]))
+	{
+		return 0; // bounding boxes do not touch
+	}
+	
+	int left = (aLeft > bLeft) ? aLeft : bLeft;
+	int right = (aRight < bRight) ? aRight : bRight;
+	int dy = bTop - aTop; // heights are at most 8, so -7..7 once the boxes overlap
+	
+	for(int x = left; x < right; x++)
+	{
+		unsigned short colA = pgm_read_byte(&a[4 + x - aLeft]);
+		unsigned short colB = pgm_read_byte(&b[4 + x - bLeft]);
+		
+		if(dy >= 0)
+		{
+			colB <<= dy;
+		}
+		else
+		{
+			colA <<= -dy;
+		}
+		if(colA & colB)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+// COLLISION END
+
+// FIXED POINT BEGIN
+// Positions and velocities are 8.8 fixed point pixels (high byte whole
+// pixels, low byte the fraction), so every speed is independent of the task
+// periods and needs no floating point. Anything that moves keeps the pixel
+// it is drawn at next to its fixed point position and only redraws when the
+// rounded position changes; drawing and collisions work on those pixels.
+typedef signed short fixed; // -128 .. 127.996 pixels
+#define FIX(pixels) ((fixed)((pixels) * 256))
+#define FIX_PIXEL(f) ((signed char)(((f) + 0x80) >> 8)) // nearest pixel
+#define FIX_STEPS(pxPerSec, periodMs) ((pxPerSec) * 256L * (periodMs) / 1000) // per task tick, usable in #if
+#define FIX_STEP(pxPerSec, periodMs) ((fixed)FIX_STEPS(pxPerSec, periodMs))
+// FIXED POINT END
+
+// speeds in pixels per second, turned into 8.8 steps of the task that moves them
+#define MENU_PERIOD 50 // ms
+#define MOVE_PERIOD 10 // ms, ships, shooters and bullets
+#define ENEMY_PERIOD 100 // ms, formation
+#ifndef SHIP_SPEED
+#define SHIP_SPEED 100
+#endif
+#ifndef BULLET_SPEED
+#define BULLET_SPEED 100
+#endif
+#ifndef ENEMY_SHOT_SPEED
+#define ENEMY_SHOT_SPEED 100
+#endif
+#ifndef ENEMY_SPEED
+#define ENEMY_SPEED 10 // formation march
+#endif
+#define SHIP_STEP FIX_STEP(SHIP_SPEED, MOVE_PERIOD)
+#define BULLET_STEP FIX_STEP(BULLET_SPEED, MOVE_PERIOD)
+#define ENEMY_SHOT_STEP FIX_STEP(ENEMY_SHOT_SPEED, MOVE_PERIOD)
+#define ENEMY_STEP FIX_STEP(ENEMY_SPEED, ENEMY_PERIOD)
+#if FIX_STEPS(SHIP_SPEED, MOVE_PERIOD) < 1 || FIX_STEPS(ENEMY_SPEED, ENEMY_PERIOD) < 1
+#error "SHIP_SPEED or ENEMY_SPEED too slow to move at all"
+#endif
+#if (LCD_WIDTH - 1) * 256L + FIX_STEPS(SHIP_SPEED, MOVE_PERIOD) > 32767 || (LCD_WIDTH - 1) * 256L + FIX_STEPS(ENEMY_SPEED, ENEMY_PERIOD) > 32767
+#error "SHIP_SPEED or ENEMY_SPEED too fast, a step off the right edge overflows fixed"
+#endif
+
+// ship, the rest of what sets the two ships apart is in shipConfigs[]
+#define SHIP_INIT_X 41 // column player 1's ship starts on, mid screen
+#define SHIP2_INIT_X 40
+
+// enemy formation - invaders move in lockstep, so only the formation origin
+// moves and each slot sits at a fixed offset from it. Size and spacing can be
+// changed at compile time (-DENEMY_ROWS=3 ...).
+#ifndef ENEMY_ROWS
+#define ENEMY_ROWS 5
+#endif
+#ifndef ENEMY_COLS
+#define ENEMY_COLS 11 // at most 16 (bits of enemyAlive[])
+#endif
+#ifndef ENEMY_DX
+#define ENEMY_DX 7 // x offset between neighbouring columns
+#endif
+#ifndef ENEMY_DY
+#define ENEMY_DY 5 // y offset between neighbouring rows
+#endif
+#if ENEMY_COLS > 16 || ENEMY_ROWS * ENEMY_COLS > 127
+#error "formation too large for the alive masks"
+#endif
+
+const unsigned char enemyNumber = ENEMY_ROWS * ENEMY_COLS;
+const unsigned char maxXEnemy = 80;
+const unsigned char minXEnemy = 3;
+const unsigned char minYEnemy = 4;
+
+// bullet pool, run by BULLETS
+#ifndef BULLET_MAX
+#define BULLET_MAX 8 // pool size, both players together
+#endif
+#ifndef BULLET_PER_SHIP
+#define BULLET_PER_SHIP 3 // shots one ship may have in flight
+#endif
+#ifndef BULLET_COOLDOWN
+#define BULLET_COOLDOWN 12 // shooter ticks between two shots of the same ship
+#endif
+#ifndef ENEMY_SHOTS
+#define ENEMY_SHOTS 3 // invader shots in flight
+#endif
+#ifndef ENEMY_FIRE_ODDS
+#define ENEMY_FIRE_ODDS 4 // the formation fires on one step in this many, on average
+#endif
+#define BULLET_RANGE 42 // rows from a muzzle to the far edge (4 -> 46, 43 -> 1)
+#define BULLET_NONE 0xFF // end of a list
+#if BULLET_MAX >= BULLET_NONE
+#error "BULLET_MAX too large for the list links"
+#endif
+#if BULLET_MAX < 2 * BULLET_PER_SHIP || BULLET_MAX < BULLET_PER_SHIP + ENEMY_SHOTS
+#error "BULLET_MAX smaller than the shots allowed in flight"
+#endif
+// A shot lives at most 255 steps (bulletSteps()), which must get it across
+// BULLET_RANGE rows (invader shots start nearer than that), and is only
+// tested where it lands, so it may not move more than the 3 rows of a
+// ship's hitbox in one step.
+#if FIX_STEPS(BULLET_SPEED, MOVE_PERIOD) * 254 < BULLET_RANGE * 256L || FIX_STEPS(ENEMY_SHOT_SPEED, MOVE_PERIOD) * 254 < BULLET_RANGE * 256L
+#error "BULLET_SPEED or ENEMY_SHOT_SPEED too slow, shots would expire mid screen"
+#endif
+#if FIX_STEPS(BULLET_SPEED, MOVE_PERIOD) > 3 * 256L || FIX_STEPS(ENEMY_SHOT_SPEED, MOVE_PERIOD) > 3 * 256L
+#error "BULLET_SPEED or ENEMY_SHOT_SPEED too fast, shots would step over the hitboxes"
+#endif
+
+#define BULLET_P1 0 // owner, fired down by the top ship
+#define BULLET_P2 1 // owner, fired up by the bottom ship
+#define BULLET_ENEMY 2 // owner, fired up at player 1 by the formation
+
+#define SHIP_HIT_P1 0x01 // shipsHit bits
+#define SHIP_HIT_P2 0x02
+
+typedef struct bullet {
+	fixed y; // 8.8, drawn at FIX_PIXEL(y)
+	fixed dy; // 8.8 rows per step, positive is down the screen
+	signed char x;
+	unsigned char life; // steps left, 0 = spent or hit, retired on the next step
+	unsigned char owner; // BULLET_P1, BULLET_P2
+	unsigned char next; // free or active list link
+} bullet;
+
+// GAME STATE BEGIN
+// Everything a game in progress is made of lives in `game`: the menu and
+// machine states, both ships, the formation and the bullet pool. A reset is
+// one copy of the PROGMEM template gameInitial. Not part of it: the
+// framebuffer, the scheduler's phase and events still in the ring. States are
+// whole bytes since the machine tables reach them through pointers; the flags
+// share one byte. Laid out widest first, so there is no padding on the host.
+typedef struct gameState {
+	fixed xPositionFix; // 8.8, player 1's ship
+	fixed xPosition2Fix;
+	fixed formXFix; // 8.8, formX is its pixel; the formation drops in whole pixels
+	unsigned short enemyRandom; // xorshift state for return fire, part of the replayed state
+	unsigned short enemyAlive[ENEMY_ROWS]; // bit c of row r set - slot alive
+	unsigned short enemyColumns; // OR of every row, the columns still alive
+	bullet bullets[BULLET_MAX];
+	unsigned char bulletFree; // first unused slot
+	unsigned char bulletActive; // first slot in flight
+	unsigned char bulletCount[3]; // slots in use per owner
+	unsigned char xPosition; // input/output, pixel player 1's ship is drawn at
+	unsigned char xPosition2;
+	unsigned char enemyLeft; // popcount of enemyAlive[] - win condition if == 0
+	signed char formX; // x of column 0, column c is at formX + c * ENEMY_DX; off the left edge while column 0 is dead
+	unsigned char formY; // y of row 0 (top), row r is at formY - r * ENEMY_DY
+	unsigned char menuState; // MenuStates
+	unsigned char moveState; // MoveStates of player 1's ship
+	unsigned char move2State;
+	unsigned char shootState; // ShootStates of player 1's gun
+	unsigned char shoot2State;
+	unsigned char enemyState; // EnemyStates
+	unsigned char shootCooldown; // shooter ticks until player 1 may fire again
+	unsigned char shoot2Cooldown;
+	unsigned char cnt; // menu ticks the game over screen has been up
+	unsigned char playingGame : 2; // 0 - menu, 1 - 1 player game, 2 - 2 player game
+	unsigned char winLose : 1; // 1 player game won
+	unsigned char formRL : 1; // 1 - left, 0 - right
+	unsigned char playerWin : 1; // 2 player game, player 1 shot player 2 down
+	unsigned char player2Win : 1;
+	unsigned char shipsHit : 2; // SHIP_HIT_* of the hits bulletsHitShips() has posted, each is posted once
+} gameState;
+
+gameState game;
+
+// Power on: every state at its *Start (0), ships at their start columns and
+// an empty pool without free slots, threaded by shipEnter() when a game starts.
+const gameState gameInitial PROGMEM = {
+	.xPositionFix = FIX(SHIP_INIT_X),
+	.xPosition2Fix = FIX(SHIP2_INIT_X),
+	.bulletFree = BULLET_NONE,
+	.bulletActive = BULLET_NONE,
+	.xPosition = SHIP_INIT_X,
+	.xPosition2 = SHIP2_INIT_X,
+	.enemyLeft = ENEMY_ROWS * ENEMY_COLS,
+};
+
+const unsigned char displayTime = 10; // .050 sec period - 5 seconds
+
+unsigned char gameEnd() // returns 1 if this call ended the game, it may end more than once in a tick
+{
+	if(game.playingGame == 0)
+	{
+		return 0;
+	}
+	game.playingGame = 0;
+	eventPost(&gameEvents, eventGameOver);
+	return 1;
+}
+// GAME STATE END
+
+
+// Moves a ship by dx (8.8) within min..max, redrawing it (erase->add) only
+// when the pixel it rounds to changes.
+void displayShipMove(const unsigned char *ship, unsigned char y, fixed *x, unsigned char *pixel, fixed dx, unsigned char min, unsigned char max)
+{
+	*x += dx;
+	if(*x < FIX(min))
+	{
+		*x = FIX(min);
+	}
+	else if(*x > FIX(max))
+	{
+		*x = FIX(max);
+	}
+	
+	if(FIX_PIXEL(*x) != *pixel)
+	{
+		spriteBlit(ship, *pixel, y, SPRITE_ERASE);
+		*pixel = FIX_PIXEL(*x);
+		spriteBlit(ship, *pixel, y, SPRITE_DRAW);
+	}
+}
+
+// BULLETS BEGIN
+// Every shot in flight lives in one fixed pool. A free list threads the
+// unused slots and an active list the ones in flight, so spawning and
+// retiring are O(1), nothing is allocated and bulletsStep() walks only live
+// bullets. Collisions are separate passes over the whole list: one against
+// the formation (bulletsHitEnemies()) and one against the ships. Every owner
+// has a hard cap and the pool holds all caps at once, so the worst case per
+// tick is a full pool (timed by ENEMY_BENCH).
+
+const unsigned char bulletCap[3] = {BULLET_PER_SHIP, BULLET_PER_SHIP, ENEMY_SHOTS};
+
+void bulletsInit() // drop every bullet without erasing, for a cleared screen
+{
+	for(unsigned char i = 0; i < BULLET_MAX; i++)
+	{
+		game.bullets[i].life = 0;
+		game.bullets[i].next = (i + 1 < BULLET_MAX) ? i + 1 : BULLET_NONE;
+	}
+	game.bulletFree = 0;
+	game.bulletActive = BULLET_NONE;
+	game.bulletCount[BULLET_P1] = 0;
+	game.bulletCount[BULLET_P2] = 0;
+	game.bulletCount[BULLET_ENEMY] = 0;
+	game.shipsHit = 0;
+}
+
+// Steps a bullet moving dy per step needs to cover rows, plus the step it
+// spends on the last one.
+unsigned char bulletSteps(unsigned char rows, fixed dy)
+{
+	unsigned short speed = (dy < 0) ? -dy : dy;
+	unsigned short steps = ((unsigned short)rows * 256 + speed - 1) / speed + 1;
+	
+	return (steps > 255) ? 255 : steps;
+}
+
+// Draws a new bullet that flies for life steps; returns its slot, or
+// BULLET_NONE if the pool or the owner's allowance is used up.
+unsigned char bulletSpawn(unsigned char owner, signed char x, signed char y, fixed dy, unsigned char life)
+{
+	unsigned char i = game.bulletFree;
+	
+	if(i == BULLET_NONE || game.bulletCount[owner] >= bulletCap[owner])
+	{
+		return BULLET_NONE;
+	}
+	game.bulletFree = game.bullets[i].next;
+	
+	game.bullets[i].x = x;
+	game.bullets[i].y = FIX(y);
+	game.bullets[i].dy = dy;
+	game.bullets[i].life = life;
+	game.bullets[i].owner = owner;
+	game.bullets[i].next = game.bulletActive;
+	game.bulletActive = i;
+	game.bulletCount[owner]++;
+	
+	spriteBlit(spriteBullet, x, y, SPRITE_DRAW);
+	return i;
+}
+
+void bulletsBlit(unsigned char op) // every bullet still drawn, to lift them off the screen and back
+{
+	for(unsigned char i = game.bulletActive; i != BULLET_NONE; i = game.bullets[i].next)
+	{
+		if(game.bullets[i].life)
+		{
+			spriteBlit(spriteBullet, game.bullets[i].x, FIX_PIXEL(game.bullets[i].y), op);
+		}
+	}
+}
+
+void bulletKill(bullet *b) // hit something, the slot is freed on the next step
+{
+	spriteBlit(spriteBullet, b->x, FIX_PIXEL(b->y), SPRITE_ERASE);
+	b->life = 0;
+}
+
+// Moves every bullet one step and retires the ones that are spent. A bullet
+// is only redrawn when the pixel it rounds to changes.
+void bulletsStep()
+{
+	unsigned char *link = &game.bulletActive;
+	
+	while(*link != BULLET_NONE)
+	{
+		unsigned char i = *link;
+		bullet *b = &game.bullets[i];
+		signed char y = FIX_PIXEL(b->y);
+		
+		if(b->life)
+		{
+			b->y += b->dy;
+			b->life--;
+			if(b->life == 0 || FIX_PIXEL(b->y) != y)
+			{
+				spriteBlit(spriteBullet, b->x, y, SPRITE_ERASE);
+				if(b->life)
+				{
+					spriteBlit(spriteBullet, b->x, FIX_PIXEL(b->y), SPRITE_DRAW);
+				}
+			}
+		}
+		if(b->life == 0) // unlink, back on the free list
+		{
+			*link = b->next;
+			b->next = game.bulletFree;
+			game.bulletFree = i;
+			game.bulletCount[b->owner]--;
+			continue;
+		}
+		link = &b->next;
+	}
+}
+
+// Bullets against the opposing ship's hurtbox: player 1's shots hit player
+// 2 (2 player game only), everyone else's hit player 1. Player shots count
+// with their tip, invader shots with the whole bullet so none grazes the
+// ship's wide side unhit. The ship state machines end the game on their
+// next tick.
+void bulletsHitShips()
+{
+	for(unsigned char i = game.bulletActive; i != BULLET_NONE; i = game.bullets[i].next)
+	{
+		bullet *b = &game.bullets[i];
+		signed char y = FIX_PIXEL(b->y);
+		
+		if(!b->life)
+		{
+			continue;
+		}
+		if(b->owner == BULLET_P1)
+		{
+			if(game.playingGame == 2 && !(game.shipsHit & SHIP_HIT_P2) && hitTest(spriteShip2, game.xPosition2, 46, hitPoint, b->x, y))
+			{
+				game.shipsHit |= SHIP_HIT_P2;
+				eventPost(&gameEvents, eventP2Hit);
+			}
+		}
+		else if(!(game.shipsHit & SHIP_HIT_P1) && hitTest(spriteShip, game.xPosition, 1, (b->owner == BULLET_ENEMY) ? spriteBullet : hitPoint, b->x, y))
+		{
+			game.shipsHit |= SHIP_HIT_P1;
+			eventPost(&gameEvents, eventP1Hit);
+		}
+	}
+}
+// BULLETS END
+
+void enemyBlitAll(int x, unsigned char y, unsigned char op) // the whole formation with column 0 at x, row 0 at y
+{
+	for(unsigned char r = 0; r < ENEMY_ROWS; r++)
+	{
+		spriteBlitRow(spriteEnemy, x, y - r * ENEMY_DY, ENEMY_DX, game.enemyAlive[r], op);
+	}
+}
+
+void enemyInit()
+{
+	game.formX = 3;
+	game.formXFix = FIX(game.formX);
+	game.formY = 45;
+	game.formRL = 1; // 1 - left, 0 - right
+	game.enemyRandom = 0xACE1;
+	
+	for(unsigned char r = 0; r < ENEMY_ROWS; r++)
+	{
+		game.enemyAlive[r] = (1UL << ENEMY_COLS) - 1;
+	}
+	enemyBlitAll(game.formX, game.formY, SPRITE_DRAW);
+	game.enemyColumns = (1UL << ENEMY_COLS) - 1;
+	game.enemyLeft = enemyNumber;
+}
+
+// The invaders move in lockstep, so a sideways step moves the formation's
+// pixels as a block: every bank it covers is memmove()d d columns over its
+// extent and only the columns it uncovers are cleared. Nothing else is ever
+// drawn in those banks but bullets, and player 1's ship once the formation is
+// down in bank 0, so those are lifted off around the move instead of being
+// dragged along (a bullet can overlap an invader for a step, so the rows one
+// touches are redrawn). Kills are erased one slot at a time by enemyKill().
+// Returns 0 (nothing moved) when the shifted extent would leave the screen.
+unsigned char enemyShift(int x, signed char d) // x - column 0 before the move
+{
+	unsigned char width = pgm_read_byte(&spriteEnemy[0]);
+	unsigned char height = pgm_read_byte(&spriteEnemy[1]);
+	int left = x + __builtin_ctz(game.enemyColumns) * ENEMY_DX + (signed char)pgm_read_byte(&spriteEnemy[2]);
+	int right = x + (sizeof(int) * 8 - 1 - __builtin_clz(game.enemyColumns)) * ENEMY_DX + (signed char)pgm_read_byte(&spriteEnemy[2]) + width - 1;
+	unsigned char lowest = ENEMY_ROWS; // rows alive, lowest is the bottom one on screen
+	unsigned char highest = 0;
+	
+	for(unsigned char r = 0; r < ENEMY_ROWS; r++)
+	{
+		if(game.enemyAlive[r])
+		{
+			if(lowest == ENEMY_ROWS)
+			{
+				lowest = r;
+			}
+			highest = r;
+		}
+	}
+	int top = game.formY - highest * ENEMY_DY + (signed char)pgm_read_byte(&spriteEnemy[3]);
+	int bottom = game.formY - lowest * ENEMY_DY + (signed char)pgm_read_byte(&spriteEnemy[3]) + height - 1;
+	
+	if(left + (d < 0 ? d : 0) < 0 || right + (d > 0 ? d : 0) >= LCD_WIDTH || top < 0 || bottom >= LCD_HEIGHT)
+	{
+		return 0;
+	}
+	
+	unsigned char liftShip = (top >> 3) == 0 && game.playingGame == 1;
+	bulletsBlit(SPRITE_ERASE);
+	if(liftShip)
+	{
+		spriteBlit(spriteShip, game.xPosition, 1, SPRITE_ERASE);
+	}
+	for(int bank = top >> 3; bank <= bottom >> 3; bank++)
+	{
+		unsigned char *row = &lcdScreen[bank * LCD_WIDTH];
+		memmove(&row[left + d], &row[left], right - left + 1);
+		if(d > 0)
+		{
+			memset(&row[left], 0, d);
+			lcdMarkSpan(bank, left, right + d);
+		}
+		else
+		{
+			memset(&row[right + d + 1], 0, -d);
+			lcdMarkSpan(bank, left + d, right);
+		}
+	}
+	
+	// a bullet lifted off where it overlapped an invader took that
+	// invader's pixels with it, so the rows it touches are drawn again
+	int bulletTop = (signed char)pgm_read_byte(&spriteBullet[3]);
+	int bulletBottom = bulletTop + pgm_read_byte(&spriteBullet[1]) - 1;
+	for(unsigned char r = lowest; r <= highest; r++)
+	{
+		int rowTop = game.formY - r * ENEMY_DY + (signed char)pgm_read_byte(&spriteEnemy[3]);
+		for(unsigned char i = game.bulletActive; i != BULLET_NONE; i = game.bullets[i].next)
+		{
+			int y = FIX_PIXEL(game.bullets[i].y);
+			if(game.bullets[i].life && y + bulletTop <= rowTop + height - 1 && y + bulletBottom >= rowTop)
+			{
+				spriteBlitRow(spriteEnemy, x + d, game.formY - r * ENEMY_DY, ENEMY_DX, game.enemyAlive[r], SPRITE_DRAW);
+				break;
 			}
 		}
 	}
+	if(liftShip)
+	{
+		spriteBlit(spriteShip, game.xPosition, 1, SPRITE_DRAW);
+	}
+	bulletsBlit(SPRITE_DRAW);
+	return 1;
+}
+
+void enemyEraseIndv(char xCoor, char yCoor)
+{
+	spriteBlit(spriteEnemy, xCoor, yCoor, SPRITE_ERASE);
+}
+
+char enemyHit(int xCoor, unsigned char yCoor, signed char bulletX, signed char bulletY) // hitbox/hurtbox setup
+{
+	return hitTest(hitEnemy, xCoor, yCoor, spriteBullet, bulletX, bulletY);
+}
+
+
+// slot (row * ENEMY_COLS + column) a bullet at x, y is hitting, or -1.
+// The bullet x picks the only candidate column, then the rows are checked
+// bottom up (the side bullets arrive from) with enemyHit() confirming.
+signed char bulletHit(signed char x, signed char y)
+{
+	int dx = x - game.formX + 1; // hitbox starts one left of the slot center
+	
+	if(dx < 0)
+	{
+		return -1;
+	}
+	
+	unsigned char col = dx / ENEMY_DX;
+	
+	if(col >= ENEMY_COLS || !(game.enemyColumns & (1 << col)))
+	{
+		return -1;
+	}
+	
+	for(signed char r = ENEMY_ROWS - 1; r >= 0; r--)
+	{
+		if((game.enemyAlive[r] & (1 << col)) && enemyHit(game.formX + col * ENEMY_DX, game.formY - r * ENEMY_DY, x, y))
+		{
+			return r * ENEMY_COLS + col;
+		}
+	}
+	return -1;
 }
 
-enum MenuStates {menuStart, menuTitle, menu1P, menu2P, menuCredits, menuCreditSelect, menuPlaying, menuPlaying2, menuGameOver, menuGameOver2} menuState;
-enum MoveStates {moveStart, moveInactive, moveWait, moveLeft, moveRight} moveState;
-enum ShootStates {shootStart, shootInactive, shootWait, shootFire, shootFired, shootHit} shootState;
-enum EnemyStates {enemyStart, enemyInactive, enemyActive} enemyState;
-enum MoveStates2 {move2Start, move2Inactive, move2Wait, move2Left, move2Right} move2State;
-enum Shoot2States {shoot2Start, shoot2Inactive, shoot2Wait, shoot2Fire, shoot2Fired, shoot2Hit} shoot2State;
+void enemyKill(unsigned char slot)
+{
+	unsigned char r = slot / ENEMY_COLS;
+	unsigned char c = slot % ENEMY_COLS;
+	
+	game.enemyAlive[r] &= ~(1 << c); // no longer care about this enemy
+	game.enemyColumns = 0;
+	game.enemyLeft = 0; // update win condition
+	for(unsigned char i = 0; i < ENEMY_ROWS; i++)
+	{
+		game.enemyColumns |= game.enemyAlive[i];
+		game.enemyLeft += __builtin_popcount(game.enemyAlive[i]);
+	}
+	enemyEraseIndv(game.formX + c * ENEMY_DX, game.formY - r * ENEMY_DY); // erase from screen
+	
+	if(game.enemyLeft == 0 && gameEnd())
+	{
+		game.winLose = 1;
+	}
+}
+
+// Kill whatever player 1's bullets are touching, returns the number of kills.
+// Called after the formation moves and after the bullets move, since the two
+// run at different rates. Bullets outside the rows the formation covers are
+// rejected before the column lookup.
+unsigned char bulletsHitEnemies()
+{
+	unsigned char kills = 0;
+	signed char enemyTop = pgm_read_byte(&hitEnemy[3]);
+	signed char bulletTop = pgm_read_byte(&spriteBullet[3]);
+	// bounding boxes as in hitTest(): top row of the formation to bottom row
+	int above = game.formY - (ENEMY_ROWS - 1) * ENEMY_DY + enemyTop - bulletTop - pgm_read_byte(&spriteBullet[1]);
+	int below = game.formY + enemyTop + pgm_read_byte(&hitEnemy[1]) - bulletTop;
+	
+	for(unsigned char i = game.bulletActive; i != BULLET_NONE; i = game.bullets[i].next)
+	{
+		bullet *b = &game.bullets[i];
+		signed char y = FIX_PIXEL(b->y);
+		
+		if(b->owner != BULLET_P1 || !b->life || y <= above || y >= below)
+		{
+			continue;
+		}
+		
+		PROFILE_BEGIN(hitStart);
+		signed char slot = bulletHit(b->x, y);
+		PROFILE_END(hitStart, bulletHitProfile);
+		
+		if(slot >= 0)
+		{
+			enemyKill(slot);
+			bulletKill(b);
+			kills++;
+		}
+	}
+	return kills;
+}
+
+void enemyMoveAll() // needs a living column, ctz/clz of 0 are undefined
+{
+	signed char oldX = game.formX;
+	unsigned char oldY = game.formY;
+	
+	// outermost living columns decide when the formation bounces
+	int leftX = game.formX + __builtin_ctz(game.enemyColumns) * ENEMY_DX;
+	int rightX = game.formX + (sizeof(int) * 8 - 1 - __builtin_clz(game.enemyColumns)) * ENEMY_DX;
+	
+	if(game.formRL == 1 && leftX > minXEnemy) // move left
+	{
+		game.formXFix -= ENEMY_STEP;
+	}
+	else if(game.formRL == 1 && leftX <= minXEnemy) // cant move left, move down then set RL to 0
+	{
+		game.formY = game.formY - 5;
+		game.formRL = 0;
+	}
+	else if(game.formRL == 0 && rightX < maxXEnemy) // move right
+	{
+		game.formXFix += ENEMY_STEP;
+	}
+	else if(game.formRL == 0 && rightX >= maxXEnemy) // cant move right move down then set RL to 1
+	{
+		game.formY = game.formY - 5;
+		game.formRL = 1;
+	}
+	game.formX = FIX_PIXEL(game.formXFix);
+	
+#ifndef ENEMY_FULL_REDRAW
+	if(game.formY == oldY && game.formX != oldX && enemyShift(oldX, game.formX - oldX))
+	{
+		oldX = game.formX; // shifted in place
+	}
+#endif
+	if(game.formY != oldY || game.formX != oldX) // drops (and edge cases) redraw the lot
+	{
+		enemyBlitAll(oldX, oldY, SPRITE_ERASE);
+		enemyBlitAll(game.formX, game.formY, SPRITE_DRAW);
+	}
+	
+	unsigned char lowest = 0; // lowest row with anyone alive
+	for(unsigned char r = 0; r < ENEMY_ROWS; r++)
+	{
+		if(game.enemyAlive[r])
+		{
+			lowest = r;
+		}
+	}
+	
+	if(!bulletsHitEnemies() && game.formY - lowest * ENEMY_DY <= minYEnemy && gameEnd())
+	{
+		game.winLose = 0; // lose condition fulfilled
+	}
+}
+
+// Return fire: on some formation steps the front invader of a random living
+// column (the one nearest player 1) shoots up the screen. The player's
+// position is stirred into the generator, so replays stay deterministic.
+void enemyFire()
+{
+	game.enemyRandom ^= game.xPosition;
+	game.enemyRandom ^= game.enemyRandom << 7;
+	game.enemyRandom ^= game.enemyRandom >> 9;
+	game.enemyRandom ^= game.enemyRandom << 8;
+	
+	if(game.enemyRandom % ENEMY_FIRE_ODDS || game.bulletCount[BULLET_ENEMY] >= ENEMY_SHOTS || !game.enemyColumns)
+	{
+		return;
+	}
+	
+	unsigned char c = (game.enemyRandom >> 8) % ENEMY_COLS;
+	while(!(game.enemyColumns & (1 << c))) // next living column
+	{
+		c = (c + 1 < ENEMY_COLS) ? c + 1 : 0;
+	}
+	signed char r = ENEMY_ROWS - 1;
+	while(!(game.enemyAlive[r] & (1 << c)))
+	{
+		r--;
+	}
+	
+	signed char y = game.formY - r * ENEMY_DY - 3; // just clear of the invader
+	if(y > 1)
+	{
+		bulletSpawn(BULLET_ENEMY, game.formX + c * ENEMY_DX, y, -ENEMY_SHOT_STEP, bulletSteps(y - 1, ENEMY_SHOT_STEP)); // down to player 1's row
+	}
+}
+
+// STATE MACHINES BEGIN
+// The ships, their guns and the formation run on one table driven engine.
+// A machine's transitions are PROGMEM rows of (state, guard, action, next);
+// every tick smStep() takes the first row of the current state whose guard
+// passes (no guard always does), moves to its next state and runs its
+// action. A state's per tick work is the action of the row that stays in it,
+// and a state with no row taken does nothing. One table serves both players,
+// the machine's arg tells guards and actions whose ship they work on. Every
+// transition goes through smStep(), the place to trace or time them from.
+// Guards react to the events in taskEvents (EVENTS) rather than polling.
+#define SM_END 0xFF // state of the row that ends a table
+
+typedef struct transition {
+	unsigned char state;
+	unsigned char (*guard)(unsigned char arg); // 0 = always
+	void (*action)(unsigned char arg); // 0 = none
+	unsigned char next;
+} transition;
+
+typedef struct machine {
+	const transition *table; // PROGMEM, ends with an SM_END row
+	unsigned char *state;
+	unsigned char arg; // player for the ship machines
+} machine;
+
+void smStep(const machine *m)
+{
+	unsigned char state = *m->state;
+	
+	for(const transition *t = m->table; pgm_read_byte(&t->state) != SM_END; t++)
+	{
+		if(pgm_read_byte(&t->state) != state)
+		{
+			continue;
+		}
+		unsigned char (*guard)(unsigned char) = (unsigned char (*)(unsigned char))pgm_read_ptr(&t->guard);
+		if(!guard || guard(m->arg))
+		{
+			void (*action)(unsigned char) = (void (*)(unsigned char))pgm_read_ptr(&t->action);
+			PROFILE_BEGIN(transitionStart);
+			*m->state = pgm_read_byte(&t->next);
+			if(action)
+			{
+				action(m->arg);
+			}
+			PROFILE_END(transitionStart, transitionProfile);
+			return;
+		}
+	}
+}
+// STATE MACHINES END
+
+enum MenuStates {menuStart, menuTitle, menu1P, menu2P, menuCredits, menuCreditSelect, menuPlaying, menuPlaying2, menuGameOver, menuGameOver2};
+enum MoveStates {moveStart, moveInactive, moveWait, moveLeft, moveRight};
+enum ShootStates {shootStart, shootInactive, shootWait, shootFire, shootReload};
+enum EnemyStates {enemyStart, enemyInactive, enemyActive};
+
+// What sets the two ships apart, indexed by the ship machines' arg
+typedef struct shipConfig {
+	const unsigned char *sprite;
+	unsigned char y; // row the ship is drawn on
+	unsigned char initX;
+	unsigned char minX;
+	unsigned char maxX;
+	unsigned char muzzleY; // row its bullets start on
+	fixed bulletStep; // 8.8 rows per step, positive is down the screen
+	unsigned char owner; // BULLET_P1, BULLET_P2
+	unsigned char hitEvent; // eventP1Hit, eventP2Hit
+	unsigned char modes; // bit n set - in the game while playingGame == n
+	unsigned short left; // INPUT_* bits
+	unsigned short right;
+	unsigned short shoot;
+	unsigned char *x;
+	fixed *xFix;
+	unsigned char *cooldown;
+} shipConfig;
+
+const shipConfig shipConfigs[2] = {
+	{spriteShip, 1, SHIP_INIT_X, 3, 81, 4, BULLET_STEP, BULLET_P1, eventP1Hit, (1 << 1) | (1 << 2),
+		INPUT_LEFT, INPUT_RIGHT, INPUT_SHOOT, &game.xPosition, &game.xPositionFix, &game.shootCooldown},
+	{spriteShip2, 46, SHIP2_INIT_X, 3, 81, 43, -BULLET_STEP, BULLET_P2, eventP2Hit, 1 << 2,
+		INPUT_LEFT2, INPUT_RIGHT2, INPUT_SHOOT2, &game.xPosition2, &game.xPosition2Fix, &game.shoot2Cooldown},
+};
+
+// The menu screens are PROGMEM images (screens.h) drawn once when a state is
+// entered; moving through the menu only redraws the cursor.
+const unsigned char menuCursorY[] = {0, 20, 40}; // 1 Player, 2 Player VS, Credits
+
+void menuCursor(unsigned char item)
+{
+	for(unsigned char i = 0; i < sizeof(menuCursorY); i++)
+	{
+		lcdSetCursor(0, menuCursorY[i]);
+		lcdWriteString(i == item ? ">" : " ", 1);
+	}
+}
+
+void menuGameOver2Screen()
+{
+	if(game.player2Win == 1 && game.playerWin == 1)
+	{
+		screenDraw(screenDraw2P);
+	}
+	else if(game.playerWin == 1)
+	{
+		screenDraw(screenTopWins);
+	}
+	else if(game.player2Win == 1)
+	{
+		screenDraw(screenBottomWins);
+	}
+	else
+	{
+		lcdClear();
+	}
+}
 
 void menuTick()
 {
-	switch(menuState) // transitions
+	switch(game.menuState) // transitions
 	{
 		case menuStart:
-			nokia_lcd_clear();
-			playingGame = 0;
-			doReset = 0;
-			menuState = menuTitle;
+			screenDraw(screenTitle);
+			game.playingGame = 0;
+			game.menuState = menuTitle;
 			break;
 		case menuTitle:
 			if(buttonShoot)
 			{
-				menuState = menu1P;
-				nokia_lcd_clear();
+				game.menuState = menu1P;
+				screenDraw(screenMenu);
+				menuCursor(0);
 			}
 			break;
 		case menu1P:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
 			else if(buttonShoot) // select
 			{
-				menuState = menuPlaying;
-				playingGame = 1;
-				nokia_lcd_clear();
+				game.menuState = menuPlaying;
+				game.playingGame = 1;
+				eventPost(&gameEvents, eventGameStart);
+				lcdClear();
 			}
 			else if(buttonDown) // move cursor down
 			{
-				menuState = menu2P;
-				nokia_lcd_clear();
+				game.menuState = menu2P;
+				menuCursor(1);
 			}
 			else if(buttonUp) // move cursor up
 			{
@@ -722,34 +1414,35 @@ void menuTick()
 		case menu2P:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
 			else if(buttonShoot) // select
 			{
-				playingGame = 2;
-				menuState = menuPlaying2;
-				nokia_lcd_clear();
+				game.playingGame = 2;
+				eventPost(&gameEvents, eventGameStart);
+				game.menuState = menuPlaying2;
+				lcdClear();
 			}
 			else if(buttonDown) // move cursor down
 			{
-				menuState = menuCredits;
-				nokia_lcd_clear();
+				game.menuState = menuCredits;
+				menuCursor(2);
 			}
 			else if(buttonUp) // move cursor up
 			{
-				menuState = menu1P;
-				nokia_lcd_clear();
+				game.menuState = menu1P;
+				menuCursor(0);
 			}
 			break;
 		case menuCredits:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
 			else if(buttonShoot) // select
 			{
-				menuState = menuCreditSelect;
-				nokia_lcd_clear();
+				game.menuState = menuCreditSelect;
+				screenDraw(screenCredits);
 			}
 			else if(buttonDown) // move cursor down
 			{
@@ -757,119 +1450,85 @@ void menuTick()
 			}
 			else if(buttonUp) // move cursor up
 			{
-				menuState = menu2P;
-				nokia_lcd_clear();
+				game.menuState = menu2P;
+				menuCursor(1);
 			}
 			break;
 		case menuCreditSelect:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
 			else if(buttonShoot) // select
 			{
-				menuState = menu1P;
-				nokia_lcd_clear();
+				game.menuState = menu1P;
+				screenDraw(screenMenu);
+				menuCursor(0);
 			}
 			break;
 		case menuPlaying:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
-			else if(playingGame == 0)
+			else if(taskEvents & EVENT_BIT(eventGameOver))
 			{
-				menuState = menuGameOver;
-				nokia_lcd_clear();
+				game.menuState = menuGameOver;
+				screenDraw(game.winLose ? screenWin : screenLose);
 			}
 			break;
 		case menuPlaying2:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
-			else if(playingGame == 0)
+			else if(taskEvents & EVENT_BIT(eventGameOver))
 			{
-				menuState = menuGameOver2;
-				nokia_lcd_clear();
+				game.menuState = menuGameOver2;
+				menuGameOver2Screen();
 			}
 			break;
 		case menuGameOver:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
-			else if(cnt >= displayTime)
+			else if(game.cnt >= displayTime)
 			{
-				menuState = menu1P;
-				cnt = 0;
-				nokia_lcd_clear();
+				game.menuState = menu1P;
+				game.cnt = 0;
+				screenDraw(screenMenu);
+				menuCursor(0);
 			}
 			break;
 		case menuGameOver2:
 			if(buttonReset)
 			{
-				doReset = 1;
+				eventPost(&gameEvents, eventReset);
 			}
-			else if(cnt >= displayTime)
+			else if(game.cnt >= displayTime)
 			{
-				menuState = menu1P;
-				cnt = 0;
-				nokia_lcd_clear();
+				game.menuState = menu1P;
+				game.cnt = 0;
+				screenDraw(screenMenu);
+				menuCursor(0);
 			}
 			break;
 	}
 	
-	switch(menuState) // actions
+	switch(game.menuState) // actions
 	{
 		case menuStart:
 			break;
 		case menuTitle:
-			// printToScreen: IMBEDDED INVADERS(centered)
-			nokia_lcd_set_cursor(0, 4);
-			nokia_lcd_write_string("IMBEDDED",1);
-			nokia_lcd_set_cursor(0, 20);
-			nokia_lcd_write_string("INVADER",2);
-			nokia_lcd_render();
-		break;
+			break;
 		case menu1P:
-			nokia_lcd_set_cursor(0, 0);
-			nokia_lcd_write_string("> 1 Player",1);
-			nokia_lcd_set_cursor(0, 20);
-			nokia_lcd_write_string("  2 Player VS",1);
-			nokia_lcd_set_cursor(0, 40);
-			nokia_lcd_write_string("  Credits",1);
-			nokia_lcd_render();
-			// printToScreen: > 1 Player
 			break;
 		case menu2P:
-			nokia_lcd_set_cursor(0, 0);
-			nokia_lcd_write_string("  1 Player",1);
-			nokia_lcd_set_cursor(0, 20);
-			nokia_lcd_write_string("> 2 Player VS",1);
-			nokia_lcd_set_cursor(0, 40);
-			nokia_lcd_write_string("  Credits",1);
-			nokia_lcd_render();
-			// printToScreen: > 2 Player
 			break;
 		case menuCredits:
-			nokia_lcd_set_cursor(0, 0);
-			nokia_lcd_write_string("  1 Player",1);
-			nokia_lcd_set_cursor(0, 20);
-			nokia_lcd_write_string("  2 Player VS",1);
-			nokia_lcd_set_cursor(0, 40);
-			nokia_lcd_write_string("> Credits",1);
-			nokia_lcd_render();
-			// printToScreen: > Credits
 			break;
 		case menuCreditSelect:
-			nokia_lcd_set_cursor(0, 0);
-			nokia_lcd_write_string("  Made by:",1);
-			nokia_lcd_set_cursor(0, 10);
-			nokia_lcd_write_string("  NRC", 1);
-			nokia_lcd_set_cursor(0, 30);
-			nokia_lcd_write_string("> Return",1);
-			nokia_lcd_render();
 			break;
 		case menuPlaying:
 			// do nothing - handled in other SMs
@@ -877,556 +1536,955 @@ void menuTick()
 		case menuPlaying2:
 			break;
 		case menuGameOver:
-			cnt++;
-			if(winLose)
-			{
-				nokia_lcd_clear();
-				nokia_lcd_set_cursor(0, 0);
-				nokia_lcd_write_string("Enemy Destroy",1);
-				nokia_lcd_set_cursor(0, 10);
-				nokia_lcd_write_string("YOU WIN", 2);
-				nokia_lcd_set_cursor(0, 40);
-				nokia_lcd_write_string(":)", 1);
-				nokia_lcd_render();
-			}
-			else
-			{
-				nokia_lcd_clear();
-				nokia_lcd_set_cursor(0, 0);
-				nokia_lcd_write_string("Enemy Invaded",1);
-				nokia_lcd_set_cursor(0, 10);
-				nokia_lcd_write_string("YOU LOSE", 2);
-				nokia_lcd_set_cursor(0, 40);
-				nokia_lcd_write_string(":(", 1);
-				nokia_lcd_render();
-			}
+			game.cnt++;
 			break;
 		case menuGameOver2:
-			cnt++;
-			if(player2Win == 1 && playerWin == 1)
-			{
-				nokia_lcd_clear();
-				nokia_lcd_set_cursor(0, 0);
-				nokia_lcd_write_string("DRAW",3);
-				nokia_lcd_render();
-			}
-			else if(playerWin == 1)
-			{
-				nokia_lcd_clear();
-				nokia_lcd_set_cursor(0, 0);
-				nokia_lcd_write_string("TOP",2);
-				nokia_lcd_set_cursor(0, 20);
-				nokia_lcd_write_string("WINS", 2);
-				//nokia_lcd_set_cursor(0, 40);
-				//nokia_lcd_write_string(":)", 1);
-				nokia_lcd_render();
-			}
-			else if(player2Win == 1)
+			game.cnt++;
+			break;
+	}
+}
+
+unsigned char smGameOver(unsigned char arg) { return taskEvents & EVENT_BIT(eventGameOver); }
+
+// ship (player's arg), moving on its joystick
+unsigned char shipPlaying(unsigned char p) { return (taskEvents & EVENT_BIT(eventGameStart)) && ((shipConfigs[p].modes >> game.playingGame) & 1); }
+unsigned char shipHit(unsigned char p) { return taskEvents & EVENT_BIT(shipConfigs[p].hitEvent); }
+
+unsigned char shipWantsLeft(unsigned char p) // move left button is pressed (not at left edge of screen)
+{
+	const shipConfig *c = &shipConfigs[p];
+	return (inputWord & c->left) && !(inputWord & c->right) && *c->x > c->minX;
+}
+
+unsigned char shipWantsRight(unsigned char p) // move right button is pressed (not at right edge of screen)
+{
+	const shipConfig *c = &shipConfigs[p];
+	return (inputWord & c->right) && !(inputWord & c->left) && *c->x < c->maxX;
+}
+
+void shipReset(unsigned char p) // no winner yet
+{
+	game.playerWin = 0;
+	game.player2Win = 0;
+}
+
+void shipEnter(unsigned char p) // call only when playing game is started
+{
+	const shipConfig *c = &shipConfigs[p];
+	
+	shipReset(p);
+	spriteBlit(c->sprite, c->initX, c->y, SPRITE_DRAW);
+	*c->x = c->initX;
+	*c->xFix = FIX(c->initX);
+	bulletsInit();
+}
+
+void shipDown(unsigned char p) // shot, the other side wins; the menu's game over screen replaces the game's
+{
+	if(p == 0)
+	{
+		game.player2Win = 1;
+		game.winLose = 0; // 1 player game: shot down by the invaders
+	}
+	else
+	{
+		game.playerWin = 1;
+	}
+	gameEnd();
+}
+
+void shipLeft(unsigned char p)
+{
+	const shipConfig *c = &shipConfigs[p];
+	displayShipMove(c->sprite, c->y, c->xFix, c->x, -SHIP_STEP, c->minX, c->maxX);
+}
+
+void shipRight(unsigned char p)
+{
+	const shipConfig *c = &shipConfigs[p];
+	displayShipMove(c->sprite, c->y, c->xFix, c->x, SHIP_STEP, c->minX, c->maxX);
+}
+
+// Left or right is taken at once from either of the other states, so a
+// change of direction has no delay.
+const transition shipMoveTable[] PROGMEM = {
+	{moveStart, 0, shipReset, moveInactive},
+	{moveInactive, shipPlaying, shipEnter, moveWait},
+	{moveWait, shipHit, shipDown, moveInactive},
+	{moveWait, smGameOver, 0, moveInactive},
+	{moveWait, shipWantsLeft, shipLeft, moveLeft},
+	{moveWait, shipWantsRight, shipRight, moveRight},
+	{moveLeft, shipHit, shipDown, moveInactive},
+	{moveLeft, smGameOver, 0, moveInactive},
+	{moveLeft, shipWantsLeft, shipLeft, moveLeft},
+	{moveLeft, shipWantsRight, shipRight, moveRight},
+	{moveLeft, 0, 0, moveWait},
+	{moveRight, shipHit, shipDown, moveInactive},
+	{moveRight, smGameOver, 0, moveInactive},
+	{moveRight, shipWantsLeft, shipLeft, moveLeft},
+	{moveRight, shipWantsRight, shipRight, moveRight},
+	{moveRight, 0, 0, moveWait},
+	{SM_END, 0, 0, SM_END},
+};
+
+// gun (player's arg): fires into the bullet pool; holding the button fires
+// again every BULLET_COOLDOWN ticks while the ship has shots left.
+unsigned char gunReady(unsigned char p)
+{
+	const shipConfig *c = &shipConfigs[p];
+	return (inputWord & c->shoot) && game.bulletCount[c->owner] < BULLET_PER_SHIP;
+}
+
+unsigned char gunCooled(unsigned char p) { return *shipConfigs[p].cooldown == 0; }
+
+void gunFire(unsigned char p)
+{
+	const shipConfig *c = &shipConfigs[p];
+	bulletSpawn(c->owner, *c->x, c->muzzleY, c->bulletStep, bulletSteps(BULLET_RANGE, BULLET_STEP));
+	*c->cooldown = BULLET_COOLDOWN;
+}
+
+void gunReload(unsigned char p) { (*shipConfigs[p].cooldown)--; }
+
+const transition shipShootTable[] PROGMEM = {
+	{shootStart, 0, 0, shootInactive},
+	{shootInactive, shipPlaying, 0, shootWait},
+	{shootWait, smGameOver, 0, shootInactive},
+	{shootWait, gunReady, gunFire, shootFire},
+	{shootFire, smGameOver, 0, shootInactive},
+	{shootFire, 0, gunReload, shootReload},
+	{shootReload, smGameOver, 0, shootInactive},
+	{shootReload, gunCooled, 0, shootWait},
+	{shootReload, 0, gunReload, shootReload},
+	{SM_END, 0, 0, SM_END},
+};
+
+// formation, only in a 1 player game
+unsigned char enemyPlaying(unsigned char arg) { return (taskEvents & EVENT_BIT(eventGameStart)) && game.playingGame == 1; }
+
+void enemyStep(unsigned char arg)
+{
+	if(!game.enemyColumns || !game.playingGame) // the last kill ended the game, eventGameOver is still in the ring
+	{
+		return;
+	}
+	PROFILE_BEGIN(moveStart);
+	enemyMoveAll();
+	PROFILE_END(moveStart, enemyMoveProfile);
+	if(game.playingGame == 1)
+	{
+		enemyFire();
+	}
+}
+
+void enemyEnter(unsigned char arg)
+{
+	enemyInit();
+	enemyStep(arg);
+}
+
+const transition enemyTable[] PROGMEM = {
+	{enemyStart, 0, 0, enemyInactive},
+	{enemyInactive, enemyPlaying, enemyEnter, enemyActive},
+	{enemyActive, smGameOver, 0, enemyInactive},
+	{enemyActive, 0, enemyStep, enemyActive},
+	{SM_END, 0, 0, SM_END},
+};
+
+const machine shipMoves[2] = {{shipMoveTable, &game.moveState, 0}, {shipMoveTable, &game.move2State, 1}};
+const machine shipGuns[2] = {{shipShootTable, &game.shootState, 0}, {shipShootTable, &game.shoot2State, 1}};
+const machine enemyMachine = {enemyTable, &game.enemyState, 0};
+
+void moveShip() { smStep(&shipMoves[0]); }
+void moveP2() { smStep(&shipMoves[1]); }
+void shipShoot() { smStep(&shipGuns[0]); }
+void shipShoot2() { smStep(&shipGuns[1]); }
+void enemyTick() { smStep(&enemyMachine); }
+
+// One step of every bullet in flight, then the collision passes.
+void bulletsTick()
+{
+	if(taskEvents & EVENT_BIT(eventGameOver)) // the menu owns the screen now
+	{
+		bulletsInit();
+		return;
+	}
+	bulletsStep();
+	if(game.enemyState == enemyActive) // bullets move faster than the formation, check here too
+	{
+		bulletsHitEnemies();
+	}
+	bulletsHitShips();
+}
+
+// SCHEDULER BEGIN
+// Each state machine runs at its own period. The timer ticks every
+// HAL_TICK_MS, which every period has to be a multiple of; a task whose
+// Idle() says it is parked is not called at all until an event it listens
+// for arrives. Any task with mail in its inbox, parked or not, runs on the
+// tick the mail is delivered and restarts its period, so every listener
+// reacts one tick after the post whatever its period; the events are in
+// taskEvents while it runs.
+#if MENU_PERIOD % HAL_TICK_MS || MOVE_PERIOD % HAL_TICK_MS || ENEMY_PERIOD % HAL_TICK_MS
+#error "task periods must be multiples of HAL_TICK_MS"
+#endif
+
+typedef struct task {
+	unsigned long period; // ms between runs
+	unsigned long elapsedTime; // ms since the task was last due
+	unsigned long runs; // times TickFct actually ran
+	void (*TickFct)(void);
+	unsigned char (*Idle)(void); // 0 = never idle
+	unsigned char listens; // EVENT_BIT()s delivered to the task
+	unsigned char inbox; // EVENT_BIT()s delivered since it last ran
+#ifdef PROFILE
+	profile cycles; // TickFct only, idle skips are not counted
+#endif
+} task;
+
+unsigned char moveShipIdle() { return game.moveState == moveInactive; }
+unsigned char moveP2Idle() { return game.move2State == moveInactive; }
+unsigned char bulletsTickIdle() { return game.bulletActive == BULLET_NONE; }
+unsigned char shipShootIdle() { return game.shootState == shootInactive; }
+unsigned char shipShoot2Idle() { return game.shoot2State == shootInactive; }
+unsigned char enemyTickIdle() { return game.enemyState == enemyInactive; }
+
+#define SHIP_EVENTS (EVENT_BIT(eventGameStart) | EVENT_BIT(eventGameOver) | EVENT_BIT(eventP1Hit) | EVENT_BIT(eventP2Hit))
+#define GAME_EVENTS (EVENT_BIT(eventGameStart) | EVENT_BIT(eventGameOver))
+
+#ifdef TELEMETRY
+#ifndef TELEMETRY_PERIOD
+#define TELEMETRY_PERIOD 100 // ms
+#endif
+#if TELEMETRY_PERIOD % HAL_TICK_MS
+#error "TELEMETRY_PERIOD must be a multiple of HAL_TICK_MS"
+#endif
+void telemetryTick();
+#endif
+
+task tasks[] = {
+	// period, elapsedTime, runs, TickFct, Idle, listens
+	{MENU_PERIOD, MENU_PERIOD, 0, menuTick, 0, EVENT_BIT(eventGameOver)},
+	{MOVE_PERIOD, MOVE_PERIOD, 0, moveShip, moveShipIdle, SHIP_EVENTS},
+	{MOVE_PERIOD, MOVE_PERIOD, 0, moveP2, moveP2Idle, SHIP_EVENTS},
+	{MOVE_PERIOD, MOVE_PERIOD, 0, bulletsTick, bulletsTickIdle, EVENT_BIT(eventGameOver)}, // before the shooters, a new bullet shows at the muzzle for a tick
+	{MOVE_PERIOD, MOVE_PERIOD, 0, shipShoot, shipShootIdle, GAME_EVENTS},
+	{MOVE_PERIOD, MOVE_PERIOD, 0, shipShoot2, shipShoot2Idle, GAME_EVENTS},
+	{ENEMY_PERIOD, ENEMY_PERIOD, 0, enemyTick, enemyTickIdle, GAME_EVENTS},
+#ifdef TELEMETRY
+	{TELEMETRY_PERIOD, TELEMETRY_PERIOD, 0, telemetryTick, 0, 0},
+#endif
+};
+const unsigned char tasksNum = sizeof(tasks) / sizeof(task);
+
+void tasksInit()
+{
+	for(unsigned char i = 0; i < tasksNum; i++)
+	{
+		tasks[i].elapsedTime = tasks[i].period; // everyone runs on the first tick
+		tasks[i].inbox = 0;
+	}
+}
+
+unsigned char tasksDeliver() // empty the event ring into the inboxes, returns the EVENT_BIT()s taken
+{
+	unsigned char e;
+	unsigned char taken = 0;
+	
+	while(eventTake(&gameEvents, &e))
+	{
+		taken |= EVENT_BIT(e);
+		for(unsigned char i = 0; i < tasksNum; i++)
+		{
+			tasks[i].inbox |= tasks[i].listens & EVENT_BIT(e);
+		}
+	}
+	return taken;
+}
+
+void tasksTick()
+{
+	for(unsigned char i = 0; i < tasksNum; i++)
+	{
+		unsigned char parked = tasks[i].Idle && tasks[i].Idle();
+		
+		if(tasks[i].elapsedTime >= tasks[i].period || tasks[i].inbox) // mail runs a task at once, parked or not
+		{
+			if(!parked || tasks[i].inbox)
 			{
-				nokia_lcd_clear();
-				nokia_lcd_set_cursor(0, 0);
-				nokia_lcd_write_string("BOTTOM",2);
-				nokia_lcd_set_cursor(0, 20);
-				nokia_lcd_write_string("WINS", 2);
-				//nokia_lcd_set_cursor(0, 40);
-				//nokia_lcd_write_string(":)", 1);
-				nokia_lcd_render();
+				taskEvents = tasks[i].inbox;
+				tasks[i].inbox = 0;
+				PROFILE_BEGIN(taskStart);
+				tasks[i].TickFct();
+				PROFILE_END(taskStart, tasks[i].cycles);
+				tasks[i].runs++;
 			}
-			break;
+			tasks[i].elapsedTime = 0;
+		}
+		tasks[i].elapsedTime += HAL_TICK_MS;
+	}
+}
+
+// Fixed timestep: TimerWait() returns the ticks since the last wait, more
+// than one when the loop overran. The ticks owed are then run as logic steps
+// back to back and that pass's render is dropped first, so the game keeps
+// its speed under load and only the frame rate gives. Past TICK_CATCHUP_MAX
+// steps the rest are let go, the game slows down rather than never catching up.
+#ifndef TICK_CATCHUP_MAX
+#define TICK_CATCHUP_MAX 4
+#endif
+unsigned long tickCatchUps; // logic steps run without a render to catch up
+unsigned long tickRenderDrops; // renders dropped because the loop was behind
+unsigned long ticksLost; // owed beyond TICK_CATCHUP_MAX, never run
+// SCHEDULER END
+
+// TELEMETRY BEGIN
+// Build with -DTELEMETRY to stream frames (format in telemetry.h) out of the
+// HAL serial port (USART0, TXD0 = PD1 on the board). Frames are queued
+// without waiting; a frame that does not fit is dropped and counted.
+// Decode on the host with tools/telemetry.c.
+#ifdef TELEMETRY
+unsigned short txDropped; // frames that did not fit
+
+void telemetrySend(unsigned char type, const unsigned char *payload, unsigned char len)
+{
+	unsigned char frame[TELEM_MAX_LEN + 4]; // sync, type, len, checksum
+	unsigned char sum = type + len;
+	
+	frame[0] = TELEM_SYNC;
+	frame[1] = type;
+	frame[2] = len;
+	for(unsigned char i = 0; i < len; i++)
+	{
+		frame[3 + i] = payload[i];
+		sum += payload[i];
+	}
+	frame[3 + len] = -sum;
+	
+	if(!halSerialWrite(frame, len + 4))
+	{
+		txDropped++;
+	}
+}
+
+void telemetryPut16(unsigned char *p, unsigned short v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+void telemetryPut32(unsigned char *p, unsigned long v)
+{
+	telemetryPut16(p, v & 0xFFFF);
+	telemetryPut16(p + 2, v >> 16);
+}
+
+void telemetryTick()
+{
+	unsigned char frame[TELEM_MAX_LEN];
+	telemetryPut16(&frame[0], halTicks());
+	frame[2] = game.menuState;
+	frame[3] = game.moveState;
+	frame[4] = game.shootState;
+	frame[5] = game.enemyState;
+	frame[6] = game.move2State;
+	frame[7] = game.shoot2State;
+	frame[8] = game.playingGame;
+	frame[9] = game.winLose;
+	frame[10] = game.enemyLeft;
+	frame[11] = enemyNumber - game.enemyLeft;
+	telemetryPut16(&frame[12], lcdBytesFrame);
+	telemetryPut16(&frame[14], txDropped);
+	telemetryPut16(&frame[16], tickCatchUps);
+	telemetryPut16(&frame[18], tickRenderDrops);
+	telemetryPut16(&frame[20], ticksLost);
+	telemetryPut16(&frame[22], lcdRenderSkips);
+	telemetrySend(TELEM_STATE, frame, TELEM_STATE_LEN);
+	
+	for(unsigned char i = 0; i < tasksNum; i++)
+	{
+		frame[0] = i;
+		telemetryPut32(&frame[1], tasks[i].runs);
+#ifdef PROFILE
+		telemetryPut16(&frame[5], tasks[i].cycles.min);
+		telemetryPut16(&frame[7], tasks[i].cycles.max);
+		telemetryPut16(&frame[9], tasks[i].cycles.count ? tasks[i].cycles.total / tasks[i].cycles.count : 0);
+#else
+		telemetryPut32(&frame[5], 0);
+		telemetryPut16(&frame[9], 0);
+#endif
+		telemetrySend(TELEM_TASK, frame, TELEM_TASK_LEN);
+	}
+	
+#ifdef PROFILE
+	telemetryPut32(&frame[0], tickOverruns);
+	telemetryPut16(&frame[4], renderProfile.min);
+	telemetryPut16(&frame[6], renderProfile.max);
+	telemetryPut16(&frame[8], renderProfile.count ? renderProfile.total / renderProfile.count : 0);
+	telemetryPut16(&frame[10], sleepProfile.min);
+	telemetryPut16(&frame[12], sleepProfile.count ? sleepProfile.total / sleepProfile.count : 0);
+	telemetryPut16(&frame[14], latencyProfile.max - latencyProfile.min);
+	telemetrySend(TELEM_TICK, frame, TELEM_TICK_LEN);
+#endif
+}
+
+#endif
+// TELEMETRY END
+
+// REPLAY BEGIN
+// inputLatch() runs at the start of every tick. It plays the input word back
+// from a recording while there is one, otherwise reads the hardware, and
+// records the word as run length records (replay.h). Backends that define
+// HAL_REPLAY store and play back the records; those that also define
+// HAL_CHECKSUM get a checksum of the game state and framebuffer after every
+// tick, so a replay can be checked bit for bit against the run it was
+// recorded from. With -DTELEMETRY the records
+// are also sent as TELEM_INPUT frames, so a session played on the board can
+// be saved by tools/telemetry.c and replayed headless.
+unsigned long inputTicks; // ticks latched since power on
+#if defined(HAL_REPLAY) || defined(TELEMETRY)
+#define INPUT_RECORD
+unsigned short inputRunWord; // word of the run being recorded
+unsigned char inputRun; // ticks held so far, 0 - no run open
+unsigned long inputRunStart; // tick the run started on
+#endif
+#ifdef HAL_REPLAY
+unsigned short replayWord; // word of the record being played
+unsigned char replayLeft; // ticks of it still to play
+unsigned char replayOver; // no more records, back to the hardware
+#endif
+
+void inputRecordFlush() // close the open run, hal_linux.c calls it on exit too
+{
+#ifdef INPUT_RECORD
+	unsigned char record[REPLAY_RECORD_LEN];
+	
+	if(!inputRun)
+	{
+		return;
+	}
+	record[0] = inputRunWord & 0xFF;
+	record[1] = inputRunWord >> 8;
+	record[2] = inputRun;
+#ifdef HAL_REPLAY
+	halRecordWrite(record, REPLAY_RECORD_LEN);
+#endif
+#ifdef TELEMETRY
+	unsigned char frame[TELEM_INPUT_LEN];
+	telemetryPut32(&frame[0], inputRunStart);
+	for(unsigned char i = 0; i < REPLAY_RECORD_LEN; i++)
+	{
+		frame[4 + i] = record[i];
+	}
+	telemetrySend(TELEM_INPUT, frame, TELEM_INPUT_LEN);
+#endif
+	inputRun = 0;
+#endif
+}
+
+void inputLatch()
+{
+	unsigned short word;
+	
+#ifdef HAL_REPLAY
+	while(!replayLeft && !replayOver)
+	{
+		unsigned char record[REPLAY_RECORD_LEN];
+		if(halReplayRead(record, REPLAY_RECORD_LEN))
+		{
+			replayWord = record[0] | (record[1] << 8);
+			replayLeft = record[2];
+		}
+		else
+		{
+			replayOver = 1;
+		}
+	}
+	if(replayLeft)
+	{
+		word = replayWord;
+		replayLeft--;
+	}
+	else
+	{
+		word = inputRead();
+	}
+#else
+	word = inputRead();
+#endif
+	
+#ifdef INPUT_RECORD
+	if(inputRun && (word != inputRunWord || inputRun == 255))
+	{
+		inputRecordFlush();
+	}
+	if(!inputRun)
+	{
+		inputRunWord = word;
+		inputRunStart = inputTicks;
 	}
+	inputRun++;
+#endif
+	
+	inputWord = word;
+	inputTicks++;
 }
 
-void moveShip()
+#ifdef HAL_CHECKSUM
+unsigned short checksumAdd(unsigned short crc, const unsigned char *data, unsigned short len) // CRC-16/CCITT
 {
-	switch(moveState) // transitions
+	while(len--)
 	{
-		case moveStart:
-			playerWin = 0;
-			player2Win = 0;
-			moveState = moveInactive;
-			break;
-		case moveInactive:
-			if(playingGame == 1 || playingGame == 2)
-			{
-				moveState = moveWait;
-				displayShipInit();
-				xPosition = initX;
-				bulletXPos = 0;
-				bulletYPos = 0;
-				bulletXPos2 = 0;
-				bulletYPos2 = 0;
-			}
-			break;
-		case moveWait:
-			if(playerHit(xPosition, 1))
-			{
-				moveState = moveInactive;
-				nokia_lcd_clear();
-				player2Win = 1;
-				playingGame = 0;
-			}
-			else if(playingGame == 0)
-			{
-				moveState = moveInactive;
-			}
-			else if(buttonLeft && !buttonRight && (xPosition > minX)) // move left button is pressed (not at left edge of screen)
-			{
-				moveState = moveLeft;
-			}
-			else if(buttonRight && !buttonLeft && (xPosition < maxX)) // move right button is pressed (not at right edge of screen)
-			{
-				moveState = moveRight;
-			}
-			break;
-		case moveLeft:
-			if(playerHit(xPosition, 1))
-			{
-				nokia_lcd_clear();
-				moveState = moveInactive;
-				player2Win = 1;
-				playingGame = 0;
-			}
-			else if(playingGame == 0)
-			{
-				moveState = moveInactive;
-			}
-			else if(buttonLeft && !buttonRight && (xPosition > minX)) // move left button is pressed (not at left edge of screen)
-			{
-				// do nothing
-			}
-			else if(buttonRight && !buttonLeft && (xPosition < maxX)) // move right button is pressed (not at right edge of screen)
-			{
-				moveState = moveRight; // immediately move right (lessens delay)
-			}
-			else
-			{
-				moveState = moveWait;
-			}
-			break;
-		case moveRight:
-			if(playerHit(xPosition, 1))
-			{
-				nokia_lcd_clear();
-				moveState = moveInactive;
-				player2Win = 1;
-				playingGame = 0;
-			}
-			else if(playingGame == 0)
-			{
-				moveState = moveInactive;
-			}
-			else if(buttonLeft && !buttonRight && (xPosition > minX)) // move left button is pressed (not at left edge of screen)
-			{
-				moveState = moveLeft; // immediately move left (lessens delay)
-			}
-			else if(buttonRight && !buttonLeft && (xPosition < maxX)) // move right button is pressed (not at right edge of screen)
-			{
-				// do nothing
-			}
-			else
-			{
-				moveState = moveWait;
-			}
-			break;
+		crc ^= *data++ << 8;
+		for(unsigned char i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
 	}
+	return crc;
+}
+
+unsigned short stateChecksum()
+{
+	unsigned short crc = checksumAdd(0xFFFF, (const unsigned char *)&game, sizeof(game)); // no padding, see GAME STATE
 	
-	switch(moveState) // actions
+	for(unsigned char i = 0; i < tasksNum; i++)
 	{
-		case moveStart:
-			break;
-		case moveInactive:
-			break;
-		case moveWait:
-			// display ship position - not moving
-			break;
-		case moveLeft:
-			displayMoveLeft(xPosition); // change display (erase->add)
-			xPosition--;
-			break;
-		case moveRight:
-			displayMoveRight(xPosition); // change display (erase->add)
-			xPosition++;
-			break;
+		unsigned char elapsed = tasks[i].elapsedTime / HAL_TICK_MS; // scheduler phase
+		crc = checksumAdd(crc, &elapsed, 1);
 	}
+	return checksumAdd(crc, lcdScreen, LCD_BANKS * LCD_WIDTH);
 }
 
-void shipShoot()
+#define REPLAY_CHECKSUM() halChecksum(inputTicks - 1, stateChecksum())
+#else
+#define REPLAY_CHECKSUM()
+#endif
+// REPLAY END
+
+// BENCH BEGIN
+// The benchmarks report on USART0 as "bench <name> count min max avg total"
+// lines and a closing "bench end", which tools/simbench.sh collects.
+#if defined(SIM_BENCH) || defined(ENEMY_BENCH)
+void benchWrite(const char *s)
 {
-	switch(shootState) // transitions
+	while(*s)
 	{
-		case shootStart:
-			shootState = shootInactive;
-			bulletXPos = 0;
-			bulletYPos = 0;
-			break;
-		case shootInactive:
-			if(playingGame == 1 || playingGame == 2)
-			{
-				shootState = shootWait;
-			}
-			break;
-		case shootWait:
-			if(playingGame == 0)
-			{
-				shootState = shootInactive;
-			}
-			else if(buttonShoot)
-			{
-				shootState = shootFire;
-			}
-			break;
-		case shootFire:
-			if(playingGame == 0)
-			{
-				shootState = shootInactive;
-			}
-			shootState = shootFired;
-			break;
-		case shootFired:
-			if(playingGame == 0)
-			{
-				shootState = shootInactive;
-			}
-			else if(bulletLife == 0)
-			{
-				// hitPos[0] = bulletXPos;
-				// hitPos[1] = bulletYPos;
-				eraseBullet(bulletXPos, bulletYPos);
-				bulletXPos = 0;
-				bulletYPos = 0; 
-				shootState = shootWait;
-			}
-			else if( bulletYPos >= bulletMaxY) // assumming 47 is edge of board
-			{
-				// hitPos[0] = -1;
-				// hitPos[1] = -1;
-				eraseBullet(bulletXPos, bulletYPos);
-				shootState = shootWait;
-				bulletLife = 0;
-			}
-			break;
-		case shootHit: // only so that enemy state machine can read bullet positions before it is reset
-			shootState = shootWait;
-			break;
+		while(!halSerialWrite((const unsigned char *)s, 1)); // the report is all that is left to do, so wait
+		s++;
 	}
+}
+
+void benchWriteNumber(unsigned long n)
+{
+	char buf[11];
+	unsigned char i = sizeof(buf) - 1;
 	
-	switch(shootState) // actions
+	buf[i] = 0;
+	do
 	{
-		case shootStart:
-			break;
-		case shootInactive:
-			break;
-		case shootWait:
-			bulletLife = 0;
-			bulletXPos = 0; // so that bullet doesnt stay active after enemies are hit
-			bulletYPos = 0;
-			break;
-		case shootFire:
-			bulletXPos = xPosition;
-			bulletYPos = bulletInitY;
-			bulletLife = 1;
-			displayBullet(bulletXPos, bulletYPos);
-			// erase, display shot
-			break;
-		case shootFired:
-			eraseBullet(bulletXPos, bulletYPos);
-			bulletYPos++;
-			displayBullet(bulletXPos, bulletYPos);
-			// erase, display shot
-			break;
-		case shootHit:
-			break;
+		buf[--i] = '0' + n % 10;
+		n /= 10;
+	} while(n);
+	benchWrite(&buf[i]);
+}
+
+void benchWriteLine(const char *name, unsigned char n, unsigned long count, unsigned long min, unsigned long max, unsigned long total) // bench <name><n> count min max avg total
+{
+	benchWrite("bench ");
+	benchWrite(name);
+	if(n)
+	{
+		benchWriteNumber(n);
 	}
+	benchWrite(" ");
+	benchWriteNumber(count);
+	benchWrite(" ");
+	benchWriteNumber(min);
+	benchWrite(" ");
+	benchWriteNumber(max);
+	benchWrite(" ");
+	benchWriteNumber(count ? total / count : 0);
+	benchWrite(" ");
+	benchWriteNumber(total);
+	benchWrite("\n");
 }
+#endif
 
-void enemyTick()
+// Build with -DENEMY_BENCH to run a formation benchmark instead of the game.
+// For 1..ENEMY_ROWS rows it marches a full formation until it lands, timing
+// every enemy step (erase, move, draw, collision, return fire) together with
+// a bulletsTick() over a full pool, since both can fall on the same tick, and
+// the lcdRender() after it. Player 1's shots are the dear ones to test, so
+// every slot the invaders' allowance leaves holds one, past the cap. A step can take
+// longer than the 16 bit cycle counter wraps in, so it is timed with
+// halCyclesLong(). The LCD shows the tick's cycles, then for each size the
+// worst step and render, marked ! when the two together do not fit the tick;
+// the full figures go out as enemyStep<rows> and enemyRender<rows> lines.
+#ifdef ENEMY_BENCH
+typedef struct benchSpan {
+	unsigned long min; // cycles
+	unsigned long max;
+	unsigned long total;
+	unsigned long count;
+} benchSpan;
+
+void benchSpanRecord(benchSpan *p, unsigned long cycles)
 {
-	switch(enemyState) // transitions
+	if(p->count == 0 || cycles < p->min)
 	{
-		case enemyStart:
-			enemyState = enemyInactive;
-			break;
-		case enemyInactive:
-			if(playingGame == 1)
-			{
-				enemyState = enemyActive;
-				enemyLeft = 10;
-				enemyInit();
-			}
-			break;
-		case enemyActive:
-			if(playingGame == 0)
-			{
-				enemyState = enemyInactive;
-			}
-			break;
+		p->min = cycles;
 	}
-	
-	switch(enemyState) // transitions
+	if(cycles > p->max)
 	{
-		case enemyStart:
-			break;
-		case enemyInactive:
-			break;
-		case enemyActive:
-			enemyEraseAll();
-			enemyMoveAll();
-			break;
+		p->max = cycles;
 	}
+	p->total += cycles;
+	p->count++;
 }
 
-void shipShoot2()
+void lcdWriteNumber(unsigned long n)
 {
-	switch(shoot2State) // transitions
+	char buf[11];
+	unsigned char i = sizeof(buf) - 1;
+	
+	buf[i] = 0;
+	do
 	{
-		case shoot2Start:
-			shoot2State = shoot2Inactive;
-			break;
-		case shoot2Inactive:
-			if(playingGame == 2)
-			{
-				shoot2State = shoot2Wait;
-				playerWin = 0;
-				player2Win = 0;
-			}
-			break;
-		case shoot2Wait:
-			if(playingGame == 0)
-			{
-				shoot2State = shoot2Inactive;
-			}
-			else if(buttonShoot2)
-			{
-				shoot2State = shoot2Fire;
-			}
-			break;
-		case shoot2Fire:
-			shoot2State = shoot2Fired;
-			if(playingGame == 0)
-			{
-				shoot2State = shoot2Inactive;
-			}
-			break;
-		case shoot2Fired:
-			if(playingGame == 0)
-			{
-				shoot2State = shoot2Inactive;
-			}
-			else if( bulletYPos2 <= maxY2) // assumming 47 is edge of board
-			{
-				// hitPos[0] = -1;
-				// hitPos[1] = -1;
-				eraseBullet(bulletXPos2, bulletYPos2);
-				shoot2State = shoot2Wait;
-			}
-			break;
-		case shoot2Hit: // only so that enemy state machine can read bullet positions before it is reset
-			shoot2State = shoot2Wait;
-			break;
-	}
+		buf[--i] = '0' + n % 10;
+		n /= 10;
+	} while(n);
+	lcdWriteString(&buf[i], 1);
+}
+
+void enemyBench(void)
+{
+	benchSpan steps[ENEMY_ROWS];
+	benchSpan renders[ENEMY_ROWS];
+	const unsigned long tick = F_CPU / 1000 * HAL_TICK_MS; // cycles in a scheduler tick
+	unsigned long t;
 	
-	switch(shoot2State) // actions
-	{
-		case shoot2Start:
-		break;
-		case shoot2Wait:
-		bulletXPos2 = 0; // so that bullet doesnt stay active after enemies are hit
-		bulletYPos2 = 0;
-		break;
-		case shoot2Fire:
-		bulletXPos2 = xPosition2;
-		bulletYPos2 = bulletInitY2;
-		displayBullet(bulletXPos2, bulletYPos2);
-		// erase, display shot
-		break;
-		case shoot2Fired:
-		eraseBullet(bulletXPos2, bulletYPos2);
-		bulletYPos2--;
-		displayBullet(bulletXPos2, bulletYPos2);
-		// erase, display shot
-		break;
-		case shoot2Hit:
-		break;
-		case shoot2Inactive:
-		break;
-	}
-}
-
-	void moveP2()
-	{
-		switch(move2State) // transitions
+	halCyclesInit();
+	memset(steps, 0, sizeof(steps));
+	memset(renders, 0, sizeof(renders));
+	
+	for(unsigned char rows = 1; rows <= ENEMY_ROWS; rows++)
+	{
+		lcdClear();
+		enemyInit();
+		for(unsigned char r = rows; r < ENEMY_ROWS; r++) // drop the rows not under test
 		{
-			case move2Start:
-				playerWin = 0;
-				player2Win = 0;
-				move2State = move2Inactive;
-				break;
-			case move2Inactive:
-			if(playingGame == 2)
+			spriteBlitRow(spriteEnemy, game.formX, game.formY - r * ENEMY_DY, ENEMY_DX, game.enemyAlive[r], SPRITE_ERASE);
+			game.enemyAlive[r] = 0;
+		}
+		game.enemyLeft = rows * ENEMY_COLS;
+		lcdRender();
+		
+		game.playingGame = 1;
+		game.enemyState = enemyActive;
+		bulletsInit(); // every slot of the pool: the invaders' allowance, the rest player 1's
+		while(game.bulletFree != BULLET_NONE)
+		{
+			bulletSpawn(game.bulletCount[BULLET_ENEMY] < ENEMY_SHOTS ? BULLET_ENEMY : BULLET_P1, 0, 0, 0, 255);
+			game.bulletCount[BULLET_P1] = 0; // past player 1's cap, more than a game can have in flight
+		}
+		for(unsigned char step = 0; game.playingGame; step++)
+		{
+			// player 1's between two columns on the bottom row: inside the
+			// formation's rows but never hitting, so bulletHit() walks every
+			// row of its column. The invaders' mid screen, missing the ship.
+			unsigned char k = step;
+			for(unsigned char i = game.bulletActive; i != BULLET_NONE; i = game.bullets[i].next)
 			{
-				move2State = move2Wait;
-				displayShipInit2();
-				xPosition2 = initX2;
+				game.bullets[i].x = game.formX + (k++ % ENEMY_COLS) * ENEMY_DX + ENEMY_DX / 2;
+				game.bullets[i].y = FIX((game.bullets[i].owner == BULLET_P1) ? game.formY : 24);
+				game.bullets[i].life = 255;
 			}
+			
+			t = halCyclesLong();
+			enemyMoveAll();
+			enemyFire();
+			bulletsTick();
+			benchSpanRecord(&steps[rows - 1], halCyclesLong() - t);
+			
+			t = halCyclesLong();
+			lcdRender();
+			benchSpanRecord(&renders[rows - 1], halCyclesLong() - t);
+		}
+	}
+	
+	lcdClear();
+	lcdWriteString("tick ", 1);
+	lcdWriteNumber(tick);
+	for(unsigned char r = 0; r < ENEMY_ROWS && r < 5; r++)
+	{
+		lcdSetCursor(0, 8 * (r + 1));
+		lcdWriteNumber(r + 1);
+		lcdWriteString(steps[r].max + renders[r].max > tick ? "!" : " ", 1);
+		lcdWriteNumber(steps[r].max);
+		lcdWriteString(" ", 1);
+		lcdWriteNumber(renders[r].max);
+	}
+	lcdRender();
+	
+	for(unsigned char r = 0; r < ENEMY_ROWS; r++)
+	{
+		benchWriteLine("enemyStep", r + 1, steps[r].count, steps[r].min, steps[r].max, steps[r].total);
+		benchWriteLine("enemyRender", r + 1, renders[r].count, renders[r].min, renders[r].max, renders[r].total);
+	}
+	benchWrite("bench end\n");
+	while(halLcdBusy()); // the results are the last frame
+	halHalt();
+}
+#endif
+
+// Build with -DSIM_BENCH (and -DREPLAY_DATA, see hal_avr.c) to play a fixed
+// recording and, when it runs out, send the profile of every task, the tick,
+// the render and the hot paths out of the serial port and halt. Run under
+// simavr by tools/simbench.sh, which turns the report into a results file.
+// Single measurements are 16 bit, so the report is only valid while every
+// max stays below 65535 cycles.
+#ifdef SIM_BENCH
+#ifndef HAL_REPLAY
+#error "SIM_BENCH needs a recording to play (-DREPLAY_DATA=...)"
+#endif
+
+const char *benchTaskNames[] = {"menuTick", "moveShip", "moveP2", "bulletsTick", "shipShoot", "shipShoot2", "enemyTick", "telemetryTick"}; // tasks[] order
+
+void benchWriteProfile(const char *name, profile *p)
+{
+	benchWriteLine(name, 0, p->count, p->min, p->max, p->total);
+}
+
+void simBenchReport()
+{
+	benchWrite("bench ticks ");
+	benchWriteNumber(inputTicks - 1); // the last latch found no record
+	benchWrite(" overruns ");
+	benchWriteNumber(tickOverruns);
+	benchWrite(" fcpu ");
+	benchWriteNumber(F_CPU);
+	benchWrite(" state ");
+	benchWriteNumber(sizeof(gameState)); // bytes a reset copies
+	benchWrite("\n");
+	
+	benchWriteProfile("tick", &tickProfile);
+	benchWriteProfile("lcdRender", &renderProfile);
+	benchWriteProfile("enemyMoveAll", &enemyMoveProfile);
+	benchWriteProfile("bulletHit", &bulletHitProfile);
+	benchWriteProfile("sleep", &sleepProfile);
+	benchWriteProfile("tickLatency", &latencyProfile);
+	benchWriteProfile("transition", &transitionProfile);
+	for(unsigned char i = 0; i < tasksNum; i++)
+	{
+		benchWriteProfile(benchTaskNames[i], &tasks[i].cycles);
+	}
+	benchWrite("bench end\n");
+	halHalt();
+}
+
+#define SIM_BENCH_DONE() if(replayOver) { simBenchReport(); }
+#else
+#define SIM_BENCH_DONE()
+#endif
+// BENCH END
+
+// CHECKPOINT BEGIN
+// A checkpoint holds everything the ticks after it depend on: the game, the
+// scheduler's phase and inboxes, the events still in the ring and where the
+// input stands. The framebuffer is not in it; gameRestore() redraws it from
+// the state, every ship, invader and live bullet the way the game left them.
+// Backends that define HAL_CHECKPOINT are asked after every tick whether to
+// take one or go back to it (hal_linux.c -c checks a rewound run against its
+// checksum log), and keep their own input position with it.
+#ifdef HAL_CHECKPOINT
+typedef struct checkpoint {
+	gameState game;
+	eventRing events;
+	unsigned long elapsedTime[sizeof(tasks) / sizeof(task)];
+	unsigned char inbox[sizeof(tasks) / sizeof(task)];
+	unsigned long inputTicks;
+#ifdef HAL_REPLAY
+	unsigned short replayWord;
+	unsigned char replayLeft;
+	unsigned char replayOver;
+#endif
+} checkpoint;
+
+checkpoint gameCheckpoint; // the one the backend asked for
+
+void gameSnapshot(checkpoint *to) // between ticks only
+{
+	memcpy(&to->game, &game, sizeof(game));
+	to->events = gameEvents;
+	for(unsigned char i = 0; i < tasksNum; i++)
+	{
+		to->elapsedTime[i] = tasks[i].elapsedTime;
+		to->inbox[i] = tasks[i].inbox;
+	}
+	to->inputTicks = inputTicks;
+#ifdef HAL_REPLAY
+	to->replayWord = replayWord;
+	to->replayLeft = replayLeft;
+	to->replayOver = replayOver;
+#endif
+}
+
+void gameRedraw() // the screen of the state in game, on a cleared one
+{
+	lcdClear();
+	switch(game.menuState)
+	{
+		case menuTitle:
+			screenDraw(screenTitle);
 			break;
-			case move2Wait:
-			if(playerHit2(xPosition2, 46))
-			{
-				move2State = move2Inactive;
-				nokia_lcd_clear();
-				playerWin = 1;
-				playingGame = 0;
-			}
-			else if(playingGame == 0)
-			{
-				move2State = move2Inactive;
-			}
-			else if(buttonLeft2 && !buttonRight2 && (xPosition2 > minX2)) // move left button is pressed (not at left edge of screen)
-			{
-				move2State = move2Left;
-			}
-			else if(buttonRight2 && !buttonLeft2 && (xPosition2 < maxX2)) // move right button is pressed (not at right edge of screen)
-			{
-				move2State = move2Right;
-			}
+		case menu1P:
+		case menu2P:
+		case menuCredits:
+			screenDraw(screenMenu);
+			menuCursor(game.menuState - menu1P);
 			break;
-			case move2Left:
-			if(playerHit2(xPosition2, 46))
-			{
-				move2State = move2Inactive;
-				playerWin = 1;
-				playingGame = 0;
-			}
-			else if(playingGame == 0)
-			{
-				move2State = move2Inactive;
-			}
-			else if(buttonLeft2 && !buttonRight2 && (xPosition2 > minX2)) // move left button is pressed (not at left edge of screen)
-			{
-				// do nothing
-			}
-			else if(buttonRight2 && !buttonLeft2 && (xPosition2 < maxX2)) // move right button is pressed (not at right edge of screen)
-			{
-				move2State = move2Right; // immediately move right (lessens delay)
-			}
-			else
-			{
-				move2State = move2Wait;
-			}
+		case menuCreditSelect:
+			screenDraw(screenCredits);
 			break;
-			case move2Right:
-			if(playerHit2(xPosition2, 46))
-			{
-				move2State = move2Inactive;
-				nokia_lcd_clear();
-				playerWin = 1;
-				playingGame = 0;
-			}
-			else if(playingGame == 0)
-			{
-				move2State = move2Inactive;
-			}
-			else if(buttonLeft2 && !buttonRight2 && (xPosition2 > minX)) // move left button is pressed (not at left edge of screen)
-			{
-				move2State = move2Left; // immediately move left (lessens delay)
-			}
-			else if(buttonRight2 && !buttonLeft2 && (xPosition2 < maxX)) // move right button is pressed (not at right edge of screen)
+		case menuPlaying:
+		case menuPlaying2:
+			for(unsigned char p = 0; p < 2; p++)
 			{
-				// do nothing
+				unsigned char mode = game.menuState == menuPlaying ? 1 : 2;
+				// a ship stays on screen from shipEnter() until the game over screen
+				if(((shipConfigs[p].modes >> mode) & 1) && (*shipMoves[p].state > moveInactive || game.playingGame == 0))
+				{
+					spriteBlit(shipConfigs[p].sprite, *shipConfigs[p].x, shipConfigs[p].y, SPRITE_DRAW);
+				}
 			}
-			else
+			if(game.enemyState == enemyActive)
 			{
-				move2State = move2Wait;
+				enemyBlitAll(game.formX, game.formY, SPRITE_DRAW);
 			}
+			bulletsBlit(SPRITE_DRAW);
 			break;
-		}
-		
-		switch(move2State) // actions
-		{
-			case move2Start:
-			break;
-			case move2Inactive:
-			break;
-			case move2Wait:
-			// display ship position - not moving
-			break;
-			case move2Left:
-			displayMoveLeft2(xPosition2); // change display (erase->add)
-			xPosition2--;
+		case menuGameOver:
+			screenDraw(game.winLose ? screenWin : screenLose);
 			break;
-			case move2Right:
-			displayMoveRight2(xPosition2); // change display (erase->add)
-			xPosition2++;
+		case menuGameOver2:
+			menuGameOver2Screen();
 			break;
-		}
 	}
+}
 
-int main(void)
+void gameRestore(const checkpoint *from) // between ticks only
+{
+	inputRecordFlush(); // the open run ends where the rewind starts
+	memcpy(&game, &from->game, sizeof(game));
+	gameEvents = from->events;
+	for(unsigned char i = 0; i < tasksNum; i++)
+	{
+		tasks[i].elapsedTime = from->elapsedTime[i];
+		tasks[i].inbox = from->inbox[i];
+	}
+	inputTicks = from->inputTicks;
+#ifdef HAL_REPLAY
+	replayWord = from->replayWord;
+	replayLeft = from->replayLeft;
+	replayOver = from->replayOver;
+#endif
+	gameRedraw();
+}
+
+void checkpointTick()
 {
-    DDRB = 0x00; PORTB = 0xFF; // Configure port B's 8 pins as inputs
-    DDRD = 0xFF; PORTD = 0x00; // Configure port D's 8 pins as outputs
+	unsigned char op = halCheckpoint(inputTicks - 1);
 	
-	TimerSet(1); // period 50 for now
-	TimerOn();
+	if(op == HAL_CHECKPOINT_TAKE)
+	{
+		gameSnapshot(&gameCheckpoint);
+	}
+	else if(op == HAL_CHECKPOINT_RESTORE)
+	{
+		gameRestore(&gameCheckpoint);
+	}
+}
+#define CHECKPOINT_TICK() checkpointTick()
+#else
+#define CHECKPOINT_TICK()
+#endif
+// CHECKPOINT END
+
+void gameReset();
+
+void gameStep() // one tick of game logic
+{
+	PROFILE_BEGIN(tickStart);
+	inputLatch();
+	SIM_BENCH_DONE();
+	if(tasksDeliver() & EVENT_BIT(eventReset))
+	{
+		gameReset();
+	}
+	tasksTick();
+	PROFILE_END(tickStart, tickProfile);
+	REPLAY_CHECKSUM();
+	CHECKPOINT_TICK();
+}
+
+void gameReset()
+{
+	memcpy_P(&game, &gameInitial, sizeof(game));
+	tasksInit();
+	lcdClear();
+}
+
+#ifdef HAL_LINUX
+int gameMain(void) // hal_linux.c owns main() for the command line
+#else
+int main(void)
+#endif
+{
+	tasksInit();
+	PROFILE_INIT();
+	SERIAL_INIT();
 	
-	nokia_lcd_init(); // display
-	nokia_lcd_clear();
+	halLcdInit(); // display
+	lcdClear();
 	
-	InitADC(); // controller
+	halInputInit(); // controller
 	
-	xPosition = initX; // maybe 41 - mid screen on start up
-	bulletXPos = 0;
-	bulletYPos = 0;
-	enemyLeft = 10;
-	playingGame = 0; // should initialize to zero with menu added
-	cnt = 0;
-	xPosition2 = initX2;
-	bulletXPos2 = 0;
-	bulletYPos2 = 0;
+	TimerOn(); // after the display's reset delays, or the first TimerWait() owes ticks for them
 	
-	doReset = 0;
+#ifdef ENEMY_BENCH
+	enemyBench();
+#endif
 	
-	moveState = moveStart;
-	shootState = shootStart;
-	enemyState = enemyStart;
-	move2State = move2Start;
-	shoot2State = shoot2Start;
+	memcpy_P(&game, &gameInitial, sizeof(game));
 	
 	while(1)
 	{
-		menuTick();
-		moveShip();
-		moveP2();
-		shipShoot();
-		shipShoot2();
-		enemyTick();
-		
+		gameStep();
+		PROFILE_OVERRUN(); // last tick's render plus this tick's tasks did not fit
 		
-		while(!TimerFlag);
-		TimerFlag = 0;
+		unsigned char due = TimerWait(); // ticks since the last wait
+		PROFILE_SLEEP();
 		
-		nokia_lcd_render();
-		
-		if(doReset == 1)
+		if(due > 1) // behind: no render this time, catch the game up instead
 		{
-			xPosition = initX; // maybe 41 - mid screen on start up
-			bulletXPos = 0;
-			bulletYPos = 0;
-			enemyLeft = 10;
-			playingGame = 0; // should initialize to zero with menu added
-			cnt = 0;
-			xPosition2 = initX2;
-			bulletXPos2 = 0;
-			bulletYPos2 = 0;
-			bulletLife = 0;
-			
-			menuState = menuStart;
-			moveState = moveStart;
-			shootState = shootStart;
-			enemyState = enemyStart;
-			move2State = move2Start;
-			shoot2State = shoot2Start;
-			nokia_lcd_clear();
+			tickRenderDrops++;
+			if(due > TICK_CATCHUP_MAX + 1)
+			{
+				ticksLost += due - TICK_CATCHUP_MAX - 1;
+				due = TICK_CATCHUP_MAX + 1;
+			}
+			while(--due)
+			{
+				gameStep();
+				tickCatchUps++;
+			}
+		}
+		else
+		{
+			PROFILE_BEGIN(renderStart);
+			lcdRender();
+			PROFILE_END(renderStart, renderProfile);
 		}
 	}
 }
@@ -0,0 +1,34 @@
+/*
+ * Input recording format, shared by the firmware (main.c), the headless
+ * backend (hal_linux.c) and the telemetry decoder (tools/telemetry.c).
+ *
+ * The game samples its inputs once per scheduler tick into one word of
+ * INPUT_* bits. A recording is REPLAY_MAGIC followed by run length records
+ * of REPLAY_RECORD_LEN bytes:
+ *	0	u16 input word (little endian)
+ *	2	u8 ticks the word was held, 1-255 (longer holds take more records)
+ * starting at the first tick after power on. Replaying the same records
+ * from power on drives the game through exactly the same states.
+ *
+ * A checksum log is one u16 (little endian) per tick: the state checksum
+ * taken right after that tick's tasks ran.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#define REPLAY_MAGIC "INP1"
+#define REPLAY_MAGIC_LEN 4
+#define REPLAY_RECORD_LEN 3
+
+#define INPUT_UP 0x0001
+#define INPUT_DOWN 0x0002
+#define INPUT_LEFT 0x0004
+#define INPUT_RIGHT 0x0008
+#define INPUT_LEFT2 0x0010
+#define INPUT_RIGHT2 0x0020
+#define INPUT_SHOOT 0x0040
+#define INPUT_SHOOT2 0x0080
+#define INPUT_RESET 0x0100
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Telemetry frame format, shared by the firmware (main.c) and the host
+ * decoder (tools/telemetry.c).
+ *
+ * Every frame is: TELEM_SYNC, type, payload length, payload, checksum.
+ * The checksum makes the byte sum of type + length + payload + checksum
+ * zero. Multi byte fields are little endian.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#define TELEM_SYNC 0xA5
+
+// game state, sent every telemetry period
+#define TELEM_STATE 0x01
+#define TELEM_STATE_LEN 24
+/*	0	u16 timer ticks (raw compare matches)
+ *	2	u8 menuState
+ *	3	u8 moveState
+ *	4	u8 shootState
+ *	5	u8 enemyState
+ *	6	u8 move2State
+ *	7	u8 shoot2State
+ *	8	u8 playingGame
+ *	9	u8 winLose
+ *	10	u8 enemyLeft
+ *	11	u8 score (invaders destroyed)
+ *	12	u16 lcdBytesFrame
+ *	14	u16 telemetry frames dropped because the TX buffer was full
+ *	16	u16 catch-up steps (logic steps run without a render, wraps)
+ *	18	u16 renders dropped to catch up (wraps)
+ *	20	u16 ticks lost, owed beyond TICK_CATCHUP_MAX and never run (wraps)
+ *	22	u16 lcdRender() calls put off while the display was still sending (wraps) */
+
+// one scheduler task, sent for every task every telemetry period
+#define TELEM_TASK 0x02
+#define TELEM_TASK_LEN 11
+/*	0	u8 task index
+ *	1	u32 runs
+ *	5	u16 min cycles (0 without -DPROFILE)
+ *	7	u16 max cycles
+ *	9	u16 average cycles */
+
+// tick totals, only sent by -DPROFILE builds
+#define TELEM_TICK 0x03
+#define TELEM_TICK_LEN 16
+/*	0	u32 overrun ticks
+ *	4	u16 lcdRender() min cycles
+ *	6	u16 lcdRender() max cycles
+ *	8	u16 lcdRender() average cycles
+ *	10	u16 least of a tick spent asleep, 1/1000
+ *	12	u16 average of a tick spent asleep, 1/1000
+ *	14	u16 tick jitter, cycles (spread of the loop's start after the tick) */
+
+// one input run (replay.h), sent when the run ends
+#define TELEM_INPUT 0x04
+#define TELEM_INPUT_LEN 7
+/*	0	u32 tick the run started on (ticks since power on)
+ *	4	u16 input word
+ *	6	u8 ticks it was held */
+
+#define TELEM_MAX_LEN 24 // largest payload above
+
+#endif
@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# Generate the headers main.c includes from the art:
+#
+#	sprites.h	assets/sprites.txt through tools/mksprites.c
+#	screens.h	menu and game over screens from tools/mkscreens.c
+#
+# usage: tools/assets.sh [avr-nokia5110 directory, default .]
+# Run it before building whenever the art or the tools change.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+lib=${1:-.}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cc -O2 -o "$work/mksprites" tools/mksprites.c
+"$work/mksprites" assets/sprites.txt > "$work/sprites.h"
+mv "$work/sprites.h" sprites.h
+
+cc -O2 -Ihost -I"$lib" -o "$work/mkscreens" tools/mkscreens.c
+"$work/mkscreens" > "$work/screens.h"
+mv "$work/screens.h" screens.h
@@ -0,0 +1,428 @@
+/*
+ * Checks hitTest() against the hitbox ladders it replaced and times both.
+ *
+ * enemyHit(), playerHit() and playerHit2() of the original game are copied
+ * below unchanged apart from their names. They test the target at xCoor,
+ * yCoor against the bullet in bulletXPos/bulletYPos (player 1's) or
+ * bulletXPos2/bulletYPos2 (player 2's). Their replacements in main.c are
+ * enemyHit() and hitTest() of a ship sprite against hitPoint, the bullet tip.
+ *
+ * On the host every target position on the screen is tried against every
+ * bullet position on it and HIT_MARGIN pixels off it, in the bullets' own
+ * types (player 1's signed, player 2's unsigned as they were); any mismatch
+ * is printed and the exit status is 1:
+ *
+ * Build:	cc -O2 -Ihost -I<avr-nokia5110> -o hitcheck tools/hitcheck.c
+ * Run:		./hitcheck
+ *
+ * Built for the ATmega1284 it times both sides with the cycle counter on a
+ * sample of hits and misses around one target and prints the same "bench"
+ * lines as SIM_BENCH on USART0 (tools/simbench.sh adds them to its results):
+ *
+ * Build:	avr-gcc -mmcu=atmega1284 -DF_CPU=16000000UL -Os -o hitcheck.elf tools/hitcheck.c
+ * Run:		simavr -m atmega1284 -f 16000000 hitcheck.elf
+ */
+
+#ifdef __AVR__
+#define PROFILE
+#define HAL_SERIAL
+#else
+#define HAL_LINUX
+#include <stdio.h>
+#endif
+
+#define main gameUnused // the game's (or hal_linux.c's), this file has its own
+#include "../main.c"
+#undef main
+
+signed char bulletXPos; // output/input
+signed char bulletYPos; // output/input
+unsigned char bulletXPos2; // output/input
+unsigned char bulletYPos2; // output/input
+
+char ladderPlayerHit2(unsigned char xCoor, unsigned char yCoor) // hitbox/hurtbox setup
+{
+	if(xCoor == bulletXPos) // middle column
+	{
+		if(yCoor == bulletYPos) // middle row
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos) // "top" row
+		{
+			return 1;
+		}
+	}
+	else if((xCoor - 1) == bulletXPos) // left column
+	{
+		if(yCoor == bulletYPos) // middle row
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	else if((xCoor + 1) == bulletXPos) // right column
+	{
+		if(yCoor == bulletYPos) // middle row
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	else if((xCoor + 2) == bulletXPos) // right column
+	{
+		if((yCoor + 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	else if((xCoor - 2) == bulletXPos) // right column
+	{
+		if((yCoor + 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+char ladderPlayerHit(unsigned char xCoor, unsigned char yCoor) // hitbox/hurtbox setup
+{
+	if(xCoor == bulletXPos2) // middle column
+	{
+		if(yCoor == bulletYPos2) // middle row
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos2) // "bottom row"
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos2) // "top" row
+		{
+			return 1;
+		}
+	}
+	else if((xCoor - 1) == bulletXPos2) // left column
+	{
+		if(yCoor == bulletYPos2) // middle row
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos2) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	else if((xCoor + 1) == bulletXPos2) // right column
+	{
+		if(yCoor == bulletYPos2) // middle row
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos2) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	else if((xCoor + 2) == bulletXPos2) // right column
+	{
+		if((yCoor - 1) == bulletYPos2) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	else if((xCoor - 2) == bulletXPos2) // right column
+	{
+		if((yCoor - 1) == bulletYPos2) // "bottom row"
+		{
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+char ladderEnemyHit(unsigned char xCoor, unsigned char yCoor) // hitbox/hurtbox setup
+{
+	if(xCoor == bulletXPos) // middle column
+	{
+		if(yCoor == bulletYPos) // middle row
+		{
+			return 1;
+		}
+		else if(yCoor == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if(yCoor == (bulletYPos - 1))
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == (bulletYPos - 1))
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos) // "top" row
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == (bulletYPos - 1))
+		{
+			return 1;
+		}
+	}
+	else if((xCoor - 1) == bulletXPos) // left column
+	{
+		if(yCoor == bulletYPos) // middle row
+		{
+			return 1;
+		}
+		else if(yCoor == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if(yCoor == (bulletYPos - 1))
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == (bulletYPos - 1))
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos) // "top" row
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == (bulletYPos - 1))
+		{
+			return 1;
+		}
+	}
+	else if((xCoor + 1) == bulletXPos) // right column
+	{
+		if(yCoor == bulletYPos) // middle row
+		{
+			return 1;
+		}
+		else if(yCoor == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if(yCoor == (bulletYPos - 1))
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == bulletYPos) // "bottom row"
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if((yCoor - 1) == (bulletYPos - 1))
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == bulletYPos) // "top" row
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == (bulletYPos + 1))
+		{
+			return 1;
+		}
+		else if((yCoor + 1) == (bulletYPos - 1))
+		{
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+char newEnemyHit(unsigned char xCoor, unsigned char yCoor) // the ladders' interface, main.c underneath
+{
+	return enemyHit(xCoor, yCoor, bulletXPos, bulletYPos);
+}
+
+char newPlayerHit(unsigned char xCoor, unsigned char yCoor)
+{
+	return hitTest(spriteShip, xCoor, yCoor, hitPoint, bulletXPos2, bulletYPos2);
+}
+
+char newPlayerHit2(unsigned char xCoor, unsigned char yCoor)
+{
+	return hitTest(spriteShip2, xCoor, yCoor, hitPoint, bulletXPos, bulletYPos);
+}
+
+typedef struct hitPair {
+	const char *name;
+	char (*ladder)(unsigned char, unsigned char);
+	char (*mask)(unsigned char, unsigned char);
+	void (*aim)(int, int); // puts the bullet the pair reads at x, y in its own type
+} hitPair;
+
+void aimP1(int x, int y) { bulletXPos = x; bulletYPos = y; }
+void aimP2(int x, int y) { bulletXPos2 = x; bulletYPos2 = y; }
+
+const hitPair pairs[] = {
+	{"enemyHit", ladderEnemyHit, newEnemyHit, aimP1},
+	{"playerHit", ladderPlayerHit, newPlayerHit, aimP2},
+	{"playerHit2", ladderPlayerHit2, newPlayerHit2, aimP1},
+};
+#define PAIRS (sizeof(pairs) / sizeof(pairs[0]))
+
+#ifdef __AVR__
+#define SAMPLE_X 41 // target the sample is taken around
+#define SAMPLE_Y 23
+#define SAMPLE_REACH 4 // bullets up to this far off in x and y, hits and misses
+
+volatile char hitSink; // keeps the calls from being optimised out
+
+void hitWrite(const char *s)
+{
+	while(*s)
+	{
+		while(!halSerialWrite((const unsigned char *)s, 1));
+		s++;
+	}
+}
+
+void hitWriteNumber(unsigned long n)
+{
+	char buf[11];
+	unsigned char i = sizeof(buf) - 1;
+	
+	buf[i] = 0;
+	do
+	{
+		buf[--i] = '0' + n % 10;
+		n /= 10;
+	} while(n);
+	hitWrite(&buf[i]);
+}
+
+void hitWriteProfile(const char *name, const char *suffix, profile *p) // bench <name> count min max avg total
+{
+	hitWrite("bench ");
+	hitWrite(name);
+	hitWrite(suffix);
+	hitWrite(" ");
+	hitWriteNumber(p->count);
+	hitWrite(" ");
+	hitWriteNumber(p->min);
+	hitWrite(" ");
+	hitWriteNumber(p->max);
+	hitWrite(" ");
+	hitWriteNumber(p->count ? p->total / p->count : 0);
+	hitWrite(" ");
+	hitWriteNumber(p->total);
+	hitWrite("\n");
+}
+
+int main(void)
+{
+	halCyclesInit();
+	halSerialInit(115200);
+	sei();
+	
+	for(unsigned char i = 0; i < PAIRS; i++)
+	{
+		profile ladder = {0};
+		profile mask = {0};
+		
+		for(signed char dx = -SAMPLE_REACH; dx <= SAMPLE_REACH; dx++)
+		{
+			for(signed char dy = -SAMPLE_REACH; dy <= SAMPLE_REACH; dy++)
+			{
+				pairs[i].aim(SAMPLE_X + dx, SAMPLE_Y + dy);
+				PROFILE_BEGIN(ladderStart);
+				hitSink = pairs[i].ladder(SAMPLE_X, SAMPLE_Y);
+				PROFILE_END(ladderStart, ladder);
+				PROFILE_BEGIN(maskStart);
+				hitSink = pairs[i].mask(SAMPLE_X, SAMPLE_Y);
+				PROFILE_END(maskStart, mask);
+			}
+		}
+		hitWriteProfile(pairs[i].name, "Ladder", &ladder);
+		hitWriteProfile(pairs[i].name, "Mask", &mask);
+	}
+	hitWrite("bench end\n");
+	halHalt();
+	return 0;
+}
+#else
+#define HIT_MARGIN 16 // bullets this far off screen too, negative ones wrap in player 2's unsigned bullet
+
+int main(void)
+{
+	unsigned long mismatches = 0;
+	
+	for(unsigned char i = 0; i < PAIRS; i++)
+	{
+		unsigned long hits = 0;
+		
+		for(unsigned char x = 0; x < LCD_WIDTH; x++)
+		{
+			for(unsigned char y = 0; y < LCD_HEIGHT; y++)
+			{
+				for(int bx = -HIT_MARGIN; bx < LCD_WIDTH + HIT_MARGIN; bx++)
+				{
+					for(int by = -HIT_MARGIN; by < LCD_HEIGHT + HIT_MARGIN; by++)
+					{
+						pairs[i].aim(bx, by);
+						char old = pairs[i].ladder(x, y) != 0;
+						char now = pairs[i].mask(x, y) != 0;
+						
+						hits += old;
+						if(old != now && mismatches++ < 20)
+						{
+							printf("%s: target %u,%u bullet %d,%d - ladder %d, hitTest %d\n", pairs[i].name, x, y, bx, by, old, now);
+						}
+					}
+				}
+			}
+		}
+		printf("%s: %lu hits, every target and bullet position checked\n", pairs[i].name, hits);
+	}
+	printf("%lu mismatches\n", mismatches);
+	return mismatches != 0;
+}
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Build time generator for the menu and game over screens (screens.h).
+ *
+ * Every screen is rasterised once on the host with the LCD library's font,
+ * the same way lcdWriteString() would draw it, and written out as a run
+ * length coded PROGMEM image for screenDraw() in main.c:
+ *
+ *	c < 0x80	c + 1 literal bytes follow
+ *	c >= 0x80	the next byte repeated (c & 0x7F) + 2 times
+ *
+ * decoding to the 504 framebuffer bytes (bank major) of a full screen.
+ *
+ * Build:	cc -Ihost -I<avr-nokia5110> -o mkscreens tools/mkscreens.c
+ * Run:		./mkscreens > screens.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nokia5110_chars.h"
+
+#define LCD_WIDTH 84
+#define LCD_HEIGHT 48
+#define LCD_SIZE (LCD_WIDTH * LCD_HEIGHT / 8)
+#define MAX_LINES 4
+
+typedef struct line {
+	unsigned char x;
+	unsigned char y;
+	unsigned char scale;
+	const char *text;
+} line;
+
+typedef struct screen {
+	const char *name;
+	line lines[MAX_LINES];
+} screen;
+
+// Menu cursors (">") are not part of the images, main.c draws them.
+static const screen screens[] = {
+	{"screenTitle", {{0, 4, 1, "IMBEDDED"}, {0, 20, 2, "INVADER"}}},
+	{"screenMenu", {{0, 0, 1, "  1 Player"}, {0, 20, 1, "  2 Player VS"}, {0, 40, 1, "  Credits"}}},
+	{"screenCredits", {{0, 0, 1, "  Made by:"}, {0, 10, 1, "  NRC"}, {0, 30, 1, "> Return"}}},
+	{"screenWin", {{0, 0, 1, "Enemy Destroy"}, {0, 10, 2, "YOU WIN"}, {0, 40, 1, ":)"}}},
+	{"screenLose", {{0, 0, 1, "Enemy Invaded"}, {0, 10, 2, "YOU LOSE"}, {0, 40, 1, ":("}}},
+	{"screenDraw2P", {{0, 0, 3, "DRAW"}}},
+	{"screenTopWins", {{0, 0, 2, "TOP"}, {0, 20, 2, "WINS"}}},
+	{"screenBottomWins", {{0, 0, 2, "BOTTOM"}, {0, 20, 2, "WINS"}}},
+};
+
+static unsigned char fb[LCD_SIZE];
+static unsigned char cursorX;
+static unsigned char cursorY;
+
+static void setPixel(int x, int y, int on)
+{
+	if(x < 0 || x >= LCD_WIDTH || y < 0 || y >= LCD_HEIGHT)
+	{
+		return;
+	}
+	if(on)
+	{
+		fb[(y >> 3) * LCD_WIDTH + x] |= 1 << (y & 7);
+	}
+	else
+	{
+		fb[(y >> 3) * LCD_WIDTH + x] &= ~(1 << (y & 7));
+	}
+}
+
+static void writeChar(char code, unsigned char scale) // lcdWriteChar()
+{
+	for(unsigned char x = 0; x < 5 * scale; x++)
+	{
+		unsigned char column = pgm_read_byte(&CHARSET[code - 32][x / scale]);
+		for(unsigned char y = 0; y < 7 * scale; y++)
+		{
+			setPixel(cursorX + x, cursorY + y, column & (1 << (y / scale)));
+		}
+	}
+
+	cursorX += 5 * scale + 1;
+	if(cursorX >= LCD_WIDTH)
+	{
+		cursorX = 0;
+		cursorY += 7 * scale + 1;
+	}
+	if(cursorY >= LCD_HEIGHT)
+	{
+		cursorX = 0;
+		cursorY = 0;
+	}
+}
+
+static unsigned int encode(const unsigned char *in, unsigned char *out)
+{
+	unsigned int n = 0;
+	unsigned int i = 0;
+
+	while(i < LCD_SIZE)
+	{
+		unsigned int run = 1;
+		while(i + run < LCD_SIZE && in[i + run] == in[i] && run < 0x7F + 2)
+		{
+			run++;
+		}
+		if(run >= 2)
+		{
+			out[n++] = 0x80 | (run - 2);
+			out[n++] = in[i];
+			i += run;
+			continue;
+		}
+
+		// literals until the next run of 3 (a run of 2 costs as much as 2 literals)
+		unsigned int start = i;
+		while(i < LCD_SIZE && i - start < 0x80)
+		{
+			if(i + 2 < LCD_SIZE && in[i] == in[i + 1] && in[i] == in[i + 2])
+			{
+				break;
+			}
+			i++;
+		}
+		out[n++] = i - start - 1;
+		memcpy(&out[n], &in[start], i - start);
+		n += i - start;
+	}
+	return n;
+}
+
+int main(void)
+{
+	unsigned char packed[LCD_SIZE * 2];
+	unsigned int total = 0;
+
+	printf("// Generated by tools/mkscreens.c, do not edit.\n\n");
+	for(unsigned int s = 0; s < sizeof(screens) / sizeof(screens[0]); s++)
+	{
+		memset(fb, 0, sizeof(fb));
+		for(unsigned int l = 0; l < MAX_LINES && screens[s].lines[l].text; l++)
+		{
+			const line *ln = &screens[s].lines[l];
+			cursorX = ln->x;
+			cursorY = ln->y;
+			for(const char *c = ln->text; *c; c++)
+			{
+				writeChar(*c, ln->scale);
+			}
+		}
+
+		unsigned int n = encode(fb, packed);
+		total += n;
+		printf("const unsigned char %s[%u] PROGMEM = {", screens[s].name, n);
+		for(unsigned int i = 0; i < n; i++)
+		{
+			printf("%s0x%02X,", i % 16 ? " " : "\n\t", packed[i]);
+		}
+		printf("\n};\n\n");
+	}
+	printf("// %u bytes for %u screens\n", total, (unsigned int)(sizeof(screens) / sizeof(screens[0])));
+	return 0;
+}
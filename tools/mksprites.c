@@ -0,0 +1,347 @@
+/*
+ * Build time generator for the sprite and hitbox tables (sprites.h).
+ *
+ * Reads a sprite sheet (assets/sprites.txt, format described there) and
+ * writes every sprite in the layout spriteBlit() and hitTest() use:
+ *
+ *	width, height, x offset, y offset of the top left pixel from the
+ *	anchor, then one byte per column, bit 0 = top row
+ *
+ * so a sprite column is exactly one framebuffer byte (shifted by the row
+ * the sprite starts on), plus a table of pointers for each animation and
+ * SPRITE_MAX_WIDTH, the widest sprite, which main.c sizes buffers with.
+ *
+ * Build:	cc -o mksprites tools/mksprites.c
+ * Run:		./mksprites assets/sprites.txt > sprites.h
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SPRITES 64
+#define MAX_WIDTH 84
+#define MAX_HEIGHT 8
+
+typedef struct sprite {
+	char name[64];
+	int width;
+	int height;
+	int anchorX; // -1 until set, then the center is used
+	int anchorY;
+	char rows[MAX_HEIGHT][MAX_WIDTH + 1];
+} sprite;
+
+static sprite sprites[MAX_SPRITES];
+static int spriteCount = 0;
+static const char *sheetPath;
+static int lineNo = 0;
+
+static void fail(const char *msg, const char *arg)
+{
+	fprintf(stderr, "%s:%d: %s%s\n", sheetPath, lineNo, msg, arg ? arg : "");
+	exit(1);
+}
+
+static void addRow(sprite *s, const char *row, int len)
+{
+	if(s->height == MAX_HEIGHT)
+	{
+		fail("sprites are at most 8 rows (one LCD bank): ", s->name);
+	}
+	if(len > MAX_WIDTH)
+	{
+		fail("row wider than the LCD in ", s->name);
+	}
+	if(s->height && len != s->width)
+	{
+		fail("rows of different width in ", s->name);
+	}
+	for(int i = 0; i < len; i++)
+	{
+		if(row[i] != 'X' && row[i] != '.')
+		{
+			fail("art rows are made of 'X' and '.' in ", s->name);
+		}
+	}
+	s->width = len;
+	memcpy(s->rows[s->height], row, len);
+	s->rows[s->height][len] = 0;
+	s->height++;
+}
+
+static int pbmNumber(FILE *f)
+{
+	int c;
+	int n = 0;
+
+	while((c = getc(f)) != EOF)
+	{
+		if(c == '#')
+		{
+			while((c = getc(f)) != EOF && c != '\n');
+		}
+		else if(!isspace(c))
+		{
+			break;
+		}
+	}
+	if(!isdigit(c))
+	{
+		return -1;
+	}
+	while(isdigit(c))
+	{
+		n = n * 10 + c - '0';
+		c = getc(f);
+	}
+	return n;
+}
+
+static void loadPbm(sprite *s, const char *file)
+{
+	char path[512];
+	const char *slash = strrchr(sheetPath, '/');
+	char row[MAX_WIDTH + 1];
+
+	// relative to the sheet
+	snprintf(path, sizeof(path), "%.*s%s", slash ? (int)(slash - sheetPath + 1) : 0, sheetPath, file);
+
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		fail("cannot open ", path);
+	}
+	char magic[2];
+	if(fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || (magic[1] != '1' && magic[1] != '4'))
+	{
+		fail("not a PBM image: ", path);
+	}
+	int width = pbmNumber(f);
+	int height = pbmNumber(f);
+	if(width <= 0 || height <= 0 || width > MAX_WIDTH)
+	{
+		fail("bad PBM size: ", path);
+	}
+
+	for(int y = 0; y < height; y++)
+	{
+		for(int x = 0; x < width; x++)
+		{
+			int bit;
+			if(magic[1] == '1')
+			{
+				int c;
+				while((c = getc(f)) != EOF && isspace(c));
+				bit = c == '1';
+			}
+			else
+			{
+				static int byte;
+				if(x % 8 == 0)
+				{
+					byte = getc(f);
+				}
+				bit = (byte >> (7 - x % 8)) & 1;
+			}
+			row[x] = bit ? 'X' : '.';
+		}
+		addRow(s, row, width);
+	}
+	fclose(f);
+}
+
+static sprite *findSprite(const char *name)
+{
+	for(int i = 0; i < spriteCount; i++)
+	{
+		if(!strcmp(sprites[i].name, name))
+		{
+			return &sprites[i];
+		}
+	}
+	return 0;
+}
+
+static void writeSprite(const sprite *s)
+{
+	int ax = s->anchorX >= 0 ? s->anchorX : (s->width - 1) / 2;
+	int ay = s->anchorY >= 0 ? s->anchorY : (s->height - 1) / 2;
+
+	printf("/*");
+	for(int y = 0; y < s->height; y++)
+	{
+		printf("%s%s", y ? "\n *\t" : "\t", s->rows[y]);
+	}
+	printf(" */\n");
+
+	printf("const unsigned char %s[] PROGMEM = {%d, %d, ", s->name, s->width, s->height);
+	printf(ax ? "(unsigned char)%d, " : "%d, ", -ax);
+	printf(ay ? "(unsigned char)%d," : "%d,", -ay);
+	for(int x = 0; x < s->width; x++)
+	{
+		unsigned char column = 0;
+		for(int y = 0; y < s->height; y++)
+		{
+			if(s->rows[y][x] == 'X')
+			{
+				column |= 1 << y;
+			}
+		}
+		printf(" 0x%02X%s", column, x + 1 < s->width ? "," : "");
+	}
+	printf("};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	char line[512];
+	sprite *current = 0;
+	static char animations[8192]; // frame tables go after every sprite they point at
+	size_t used = 0;
+
+	if(argc != 2)
+	{
+		fprintf(stderr, "usage: %s sheet.txt > sprites.h\n", argv[0]);
+		return 2;
+	}
+	sheetPath = argv[1];
+	FILE *f = fopen(sheetPath, "r");
+	if(!f)
+	{
+		perror(sheetPath);
+		return 1;
+	}
+
+	printf("// Generated by tools/mksprites.c from %s, do not edit.\n\n", sheetPath);
+
+	while(fgets(line, sizeof(line), f))
+	{
+		lineNo++;
+		char *hash = strchr(line, '#');
+		char *p = line;
+
+		while(isspace((unsigned char)*p))
+		{
+			p++;
+		}
+		if(hash)
+		{
+			*hash = 0;
+		}
+		if(*p == 'X' || *p == '.') // art row
+		{
+			int len = strspn(p, "X.");
+			if(!current)
+			{
+				fail("art row outside a sprite", 0);
+			}
+			addRow(current, p, len);
+			continue;
+		}
+
+		char *word = strtok(p, " \t\r\n");
+		if(!word)
+		{
+			continue;
+		}
+		if(!strcmp(word, "sprite") || !strcmp(word, "hitbox"))
+		{
+			char *name = strtok(0, " \t\r\n");
+			if(!name || strlen(name) >= sizeof(current->name))
+			{
+				fail("missing sprite name", 0);
+			}
+			if(findSprite(name))
+			{
+				fail("duplicate sprite ", name);
+			}
+			if(spriteCount == MAX_SPRITES)
+			{
+				fail("too many sprites", 0);
+			}
+			current = &sprites[spriteCount++];
+			memset(current, 0, sizeof(*current));
+			strcpy(current->name, name);
+			current->anchorX = -1;
+			current->anchorY = -1;
+
+			char *opt = strtok(0, " \t\r\n");
+			if(opt && !strcmp(opt, "anchor"))
+			{
+				char *x = strtok(0, " \t\r\n");
+				char *y = strtok(0, " \t\r\n");
+				if(!x || !y)
+				{
+					fail("anchor needs x and y", 0);
+				}
+				current->anchorX = atoi(x);
+				current->anchorY = atoi(y);
+			}
+			else if(opt)
+			{
+				fail("unknown option ", opt);
+			}
+		}
+		else if(!strcmp(word, "file"))
+		{
+			char *file = strtok(0, " \t\r\n");
+			if(!current || !file || current->height)
+			{
+				fail("file needs a sprite without rows", 0);
+			}
+			loadPbm(current, file);
+		}
+		else if(!strcmp(word, "frames"))
+		{
+			char *name = strtok(0, " \t\r\n");
+			char *frame;
+			int count = 0;
+
+			if(!name)
+			{
+				fail("missing animation name", 0);
+			}
+			current = 0;
+			used += snprintf(&animations[used], sizeof(animations) - used, "const unsigned char *const %s[] PROGMEM = {", name);
+			while((frame = strtok(0, " \t\r\n")))
+			{
+				if(!findSprite(frame))
+				{
+					fail("unknown frame ", frame);
+				}
+				used += snprintf(&animations[used], sizeof(animations) - used, "%s%s", count ? ", " : "", frame);
+				count++;
+			}
+			used += snprintf(&animations[used], sizeof(animations) - used, "};\n#define %s_FRAMES %d\n\n", name, count);
+			if(used >= sizeof(animations))
+			{
+				fail("too many animations", 0);
+			}
+		}
+		else
+		{
+			fail("unknown keyword ", word);
+		}
+	}
+	fclose(f);
+
+	int maxWidth = 0;
+	for(int i = 0; i < spriteCount; i++)
+	{
+		if(sprites[i].height == 0)
+		{
+			lineNo = 0;
+			fail("sprite without art: ", sprites[i].name);
+		}
+		writeSprite(&sprites[i]);
+		if(sprites[i].width > maxWidth)
+		{
+			maxWidth = sprites[i].width;
+		}
+	}
+	fputs(animations, stdout);
+	printf("#define SPRITE_MAX_WIDTH %d // columns of the widest sprite above\n", maxWidth);
+	return 0;
+}
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Cycle counts of the game's hot paths on a simulated ATmega1284.
+#
+# Plays a fixed input script through the headless build to get a recording,
+# links that recording into a -DSIM_BENCH firmware, runs the firmware under
+# simavr at 16 MHz and turns the report it prints on USART0 into a CSV file:
+#
+#	name,count,min,max,avg,total		(cycles, one line per function/task)
+#
+# plus a "ticks" line (ticks played, overruns, F_CPU, bytes of game state),
+# from tools/hitcheck.c the hitbox ladders of the original game next to
+# hitTest() (<name>Ladder, <name>Mask), and from an -DENEMY_BENCH firmware
+# the formation step with a full bullet pool and the render after it for
+# each number of rows (enemyStep<rows>, enemyRender<rows>, 32 bit counts; a
+# tick is F_CPU / 1000 * 10 cycles). Compare two results files to see which
+# hot path got slower.
+#
+# usage: tools/simbench.sh [-i script] [-n ms] [-o results.csv]
+#	-i script	input script for hal_linux.c (default tools/bench.txt)
+#	-n ms		game time to record (default 30000)
+#	-o file		results file (default simbench.csv)
+#
+# Needs cc, avr-gcc and simavr on the PATH and avr-nokia5110 next to main.c.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+script=tools/bench.txt
+ms=30000
+out=simbench.csv
+while getopts i:n:o: opt
+do
+	case $opt in
+		i) script=$OPTARG ;;
+		n) ms=$OPTARG ;;
+		o) out=$OPTARG ;;
+		*) echo "usage: $0 [-i script] [-n ms] [-o results.csv]" >&2; exit 2 ;;
+	esac
+done
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# 1. record the session headless
+tools/assets.sh
+cc -O2 -DHAL_LINUX -Ihost -o "$work/invaders" main.c
+"$work/invaders" -i "$script" -n "$ms" -r "$work/bench.inp" 2>/dev/null
+
+# 2. records (minus the magic) as a PROGMEM array
+{
+	echo "const unsigned char replayData[] PROGMEM = {"
+	od -An -v -tu1 -j4 "$work/bench.inp" | sed 's/[0-9][0-9]*/&,/g'
+	echo "};"
+} > "$work/bench_input.h"
+
+# 3. firmware that plays it and reports when it runs out
+avr-gcc -mmcu=atmega1284 -DF_CPU=16000000UL -Os -DSIM_BENCH -DREPLAY_DATA="\"$work/bench_input.h\"" -o "$work/bench.elf" main.c
+avr-size "$work/bench.elf" >&2 || true
+
+# 4. run it; simavr exits when the firmware halts
+simavr -m atmega1284 -f 16000000 "$work/bench.elf" > "$work/sim.log" 2>&1 || true
+
+sed -n 's/.*bench /bench /p' "$work/sim.log" | tr -d '\r' | awk '
+	$1 == "bench" && $2 == "ticks" { printf "ticks,%s,%s,%s,%s\n", $3, $5, $7, $9; next }
+	$1 == "bench" && $2 == "end" { done = 1; next }
+	$1 == "bench" && NF == 7 { printf "%s,%s,%s,%s,%s,%s\n", $2, $3, $4, $5, $6, $7 }
+	END { if(!done) exit 1 }
+' > "$work/results.csv" || {
+	echo "simavr run did not finish, log:" >&2
+	cat "$work/sim.log" >&2
+	exit 1
+}
+
+# 5. the hitbox ladders against hitTest()
+avr-gcc -mmcu=atmega1284 -DF_CPU=16000000UL -Os -o "$work/hitcheck.elf" tools/hitcheck.c
+simavr -m atmega1284 -f 16000000 "$work/hitcheck.elf" > "$work/hit.log" 2>&1 || true
+sed -n 's/.*bench /bench /p' "$work/hit.log" | tr -d '\r' | awk '
+	$1 == "bench" && $2 == "end" { done = 1; next }
+	$1 == "bench" && NF == 7 { printf "%s,%s,%s,%s,%s,%s\n", $2, $3, $4, $5, $6, $7 }
+	END { if(!done) exit 1 }
+' >> "$work/results.csv" || {
+	echo "hitcheck run did not finish, log:" >&2
+	cat "$work/hit.log" >&2
+	exit 1
+}
+
+# 6. the formation at every size with the bullet pool full
+avr-gcc -mmcu=atmega1284 -DF_CPU=16000000UL -Os -DENEMY_BENCH -o "$work/enemy.elf" main.c
+simavr -m atmega1284 -f 16000000 "$work/enemy.elf" > "$work/enemy.log" 2>&1 || true
+sed -n 's/.*bench /bench /p' "$work/enemy.log" | tr -d '\r' | awk '
+	$1 == "bench" && $2 == "end" { done = 1; next }
+	$1 == "bench" && NF == 7 { printf "%s,%s,%s,%s,%s,%s\n", $2, $3, $4, $5, $6, $7 }
+	END { if(!done) exit 1 }
+' >> "$work/results.csv" || {
+	echo "ENEMY_BENCH run did not finish, log:" >&2
+	cat "$work/enemy.log" >&2
+	exit 1
+}
+
+{
+	echo "name,count,min,max,avg,total"
+	cat "$work/results.csv"
+} > "$out"
+cat "$out"
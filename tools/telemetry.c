@@ -0,0 +1,321 @@
+/*
+ * Host side decoder for the firmware telemetry stream (-DTELEMETRY builds).
+ *
+ * Build:	cc -O2 -o telemetry tools/telemetry.c
+ * Run:		./telemetry /dev/ttyUSB0		(serial port, set to 115200 8N1 raw)
+ *			./telemetry capture.bin		(file recorded earlier, or - for stdin)
+ *
+ * Options:
+ *	-b baud		serial speed (default 115200)
+ *	-c		CSV output, one line per frame, for gnuplot or a spreadsheet
+ *	-p		plot the worst case cycles of every task as bars after each batch
+ *	-r file		save the input runs as a recording (replay.h) for the headless
+ *			build: ./invaders -p file. Capture from power on, since a
+ *			recording always starts at the first tick.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../telemetry.h"
+#include "../replay.h"
+
+#define MAX_TASKS 16
+#define PLOT_WIDTH 60
+
+static const char *menuNames[] = {"start", "title", "1P", "2P", "credits", "creditSelect", "playing", "playing2", "gameOver", "gameOver2"};
+static const char *taskNames[] = {"menu", "ship", "ship2", "bullets", "shoot", "shoot2", "enemy", "telemetry"};
+
+static int csv = 0;
+static int plot = 0;
+static unsigned short taskMax[MAX_TASKS];
+static unsigned char taskSeen = 0;
+static FILE *recording = 0;
+static unsigned long recordingNext = 0; // tick the next run should start on
+static unsigned long recordingLost = 0; // ticks filled in as nothing pressed
+
+static unsigned short get16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned long get32(const unsigned char *p)
+{
+	return get16(p) | ((unsigned long)get16(p + 2) << 16);
+}
+
+static const char *taskName(unsigned char i)
+{
+	return i < sizeof(taskNames) / sizeof(taskNames[0]) ? taskNames[i] : "?";
+}
+
+static void plotTasks(void)
+{
+	unsigned short top = 1;
+
+	for(unsigned char i = 0; i < taskSeen; i++)
+	{
+		if(taskMax[i] > top)
+		{
+			top = taskMax[i];
+		}
+	}
+	for(unsigned char i = 0; i < taskSeen; i++)
+	{
+		int bar = (int)((unsigned long)taskMax[i] * PLOT_WIDTH / top);
+		printf("%-10s %6u |", taskName(i), taskMax[i]);
+		for(int j = 0; j < bar; j++)
+		{
+			putchar('#');
+		}
+		putchar('\n');
+	}
+}
+
+static void frameState(const unsigned char *p)
+{
+	if(plot && taskSeen)
+	{
+		plotTasks(); // a state frame starts every batch, so the last batch is complete
+		putchar('\n');
+	}
+
+	if(csv)
+	{
+		printf("state,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", get16(&p[0]), p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], get16(&p[12]), get16(&p[14]), get16(&p[16]), get16(&p[18]), get16(&p[20]), get16(&p[22]));
+		return;
+	}
+	printf("tick %5u  menu %-12s move %u shoot %u enemy %u move2 %u shoot2 %u  playing %u winLose %u  left %2u score %2u  lcd %3u B  dropped %u  catch-up %u skipped %u lost %u  render put off %u\n",
+		get16(&p[0]), p[2] < sizeof(menuNames) / sizeof(menuNames[0]) ? menuNames[p[2]] : "?",
+		p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], get16(&p[12]), get16(&p[14]), get16(&p[16]), get16(&p[18]), get16(&p[20]), get16(&p[22]));
+}
+
+static void frameTask(const unsigned char *p)
+{
+	if(p[0] < MAX_TASKS)
+	{
+		taskMax[p[0]] = get16(&p[7]);
+		if(p[0] >= taskSeen)
+		{
+			taskSeen = p[0] + 1;
+		}
+	}
+
+	if(csv)
+	{
+		printf("task,%u,%lu,%u,%u,%u\n", p[0], get32(&p[1]), get16(&p[5]), get16(&p[7]), get16(&p[9]));
+	}
+	else if(!plot)
+	{
+		printf("  task %-10s runs %8lu  cycles min %5u max %5u avg %5u\n", taskName(p[0]), get32(&p[1]), get16(&p[5]), get16(&p[7]), get16(&p[9]));
+	}
+}
+
+static void frameTick(const unsigned char *p)
+{
+	if(csv)
+	{
+		printf("tick,%lu,%u,%u,%u,%u,%u,%u\n", get32(&p[0]), get16(&p[4]), get16(&p[6]), get16(&p[8]), get16(&p[10]), get16(&p[12]), get16(&p[14]));
+	}
+	else
+	{
+		printf("  overruns %lu  render cycles min %u max %u avg %u  asleep min %u.%u%% avg %u.%u%%  jitter %u cycles\n", get32(&p[0]), get16(&p[4]), get16(&p[6]), get16(&p[8]),
+			get16(&p[10]) / 10, get16(&p[10]) % 10, get16(&p[12]) / 10, get16(&p[12]) % 10, get16(&p[14]));
+	}
+}
+
+static void frameInput(const unsigned char *p)
+{
+	unsigned long tick = get32(&p[0]);
+
+	if(csv)
+	{
+		printf("input,%lu,%u,%u\n", tick, get16(&p[4]), p[6]);
+	}
+	else if(!plot)
+	{
+		printf("  input tick %8lu  word 0x%03x for %3u ticks\n", tick, get16(&p[4]), p[6]);
+	}
+
+	if(!recording)
+	{
+		return;
+	}
+	if(tick < recordingNext)
+	{
+		fprintf(stderr, "input run at tick %lu overlaps the recording, skipped\n", tick);
+		return;
+	}
+	while(recordingNext < tick) // runs were dropped, keep the timing with idle runs
+	{
+		unsigned long gap = tick - recordingNext;
+		unsigned char idle[REPLAY_RECORD_LEN] = {0, 0, gap > 255 ? 255 : gap};
+		fwrite(idle, 1, REPLAY_RECORD_LEN, recording);
+		recordingNext += idle[2];
+		recordingLost += idle[2];
+	}
+	fwrite(&p[4], 1, REPLAY_RECORD_LEN, recording);
+	recordingNext = tick + p[6];
+}
+
+static speed_t baudFlag(long baud)
+{
+	switch(baud)
+	{
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+	}
+	fprintf(stderr, "unsupported baud rate %ld\n", baud);
+	exit(2);
+}
+
+static int openInput(const char *path, long baud)
+{
+	int fd = strcmp(path, "-") == 0 ? 0 : open(path, O_RDONLY | O_NOCTTY);
+
+	if(fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	if(isatty(fd))
+	{
+		struct termios tio;
+		if(tcgetattr(fd, &tio) < 0)
+		{
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			exit(1);
+		}
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, baudFlag(baud));
+		cfsetospeed(&tio, baudFlag(baud));
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	long baud = 115200;
+	int opt;
+
+	while((opt = getopt(argc, argv, "b:cpr:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b': baud = strtol(optarg, 0, 10); break;
+			case 'c': csv = 1; break;
+			case 'p': plot = 1; break;
+			case 'r':
+				recording = fopen(optarg, "wb");
+				if(!recording)
+				{
+					fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+					return 1;
+				}
+				fwrite(REPLAY_MAGIC, 1, REPLAY_MAGIC_LEN, recording);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-b baud] [-c] [-p] [-r file] device|file|-\n", argv[0]);
+				return 2;
+		}
+	}
+	if(optind >= argc)
+	{
+		fprintf(stderr, "usage: %s [-b baud] [-c] [-p] [-r file] device|file|-\n", argv[0]);
+		return 2;
+	}
+
+	int fd = openInput(argv[optind], baud);
+	unsigned char buf[256];
+	unsigned char frame[3 + 255 + 1]; // type, len, payload, checksum
+	unsigned int have = 0; // bytes of frame collected after the sync byte
+	unsigned long bad = 0;
+	ssize_t n;
+
+	setvbuf(stdout, 0, _IOLBF, 0);
+
+	while((n = read(fd, buf, sizeof(buf))) > 0)
+	{
+		for(ssize_t i = 0; i < n; i++)
+		{
+			if(have == 0)
+			{
+				if(buf[i] == TELEM_SYNC)
+				{
+					have = 1; // frame[] is filled from index 0 on the next byte
+					frame[0] = 0;
+				}
+				continue;
+			}
+
+			frame[have - 1] = buf[i];
+			have++;
+			if(have < 3 || have - 1 < (unsigned int)frame[1] + 3)
+			{
+				continue;
+			}
+
+			// type + len + payload + checksum collected
+			unsigned char sum = 0;
+			for(unsigned int j = 0; j < (unsigned int)frame[1] + 3; j++)
+			{
+				sum += frame[j];
+			}
+			have = 0;
+			if(sum != 0)
+			{
+				bad++;
+				continue; // resync on the next sync byte
+			}
+
+			if(frame[0] == TELEM_STATE && frame[1] == TELEM_STATE_LEN)
+			{
+				frameState(&frame[2]);
+			}
+			else if(frame[0] == TELEM_TASK && frame[1] == TELEM_TASK_LEN)
+			{
+				frameTask(&frame[2]);
+			}
+			else if(frame[0] == TELEM_TICK && frame[1] == TELEM_TICK_LEN)
+			{
+				frameTick(&frame[2]);
+			}
+			else if(frame[0] == TELEM_INPUT && frame[1] == TELEM_INPUT_LEN)
+			{
+				frameInput(&frame[2]);
+			}
+		}
+	}
+
+	if(plot && taskSeen)
+	{
+		plotTasks();
+	}
+	if(recording)
+	{
+		fclose(recording);
+		if(recordingLost)
+		{
+			fprintf(stderr, "%lu ticks of input were lost and recorded as nothing pressed\n", recordingLost);
+		}
+	}
+	if(bad)
+	{
+		fprintf(stderr, "%lu frames failed the checksum\n", bad);
+	}
+	return 0;
+}